@@ -0,0 +1,163 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "character-rom.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// A range of consecutive codepoints found consecutively in the ROM.
+struct RomRange {
+  uint32_t first;
+  uint32_t last;
+  uint8_t code;   // character code of "first".
+};
+
+// Tables are sorted by codepoint, so that we can use binary search. Only
+// characters that look like what the codepoint means are listed.
+
+// In A00, 0x5c is the Yen sign and 0x7e, 0x7f are arrows.
+static const RomRange kRomA00[] = {
+  { 0x0000, 0x005b, 0x00 },
+  { 0x005d, 0x007d, 0x5d },
+  { 0x00a2, 0x00a2, 0xec },   // ¢
+  { 0x00a5, 0x00a5, 0x5c },   // ¥
+  { 0x00b5, 0x00b5, 0xe4 },   // µ
+  { 0x00e4, 0x00e4, 0xe1 },   // ä
+  { 0x00f1, 0x00f1, 0xee },   // ñ
+  { 0x00f6, 0x00f6, 0xef },   // ö
+  { 0x00f7, 0x00f7, 0xfd },   // ÷
+  { 0x00fc, 0x00fc, 0xf5 },   // ü
+  { 0x03a3, 0x03a3, 0xf6 },   // Σ
+  { 0x03a9, 0x03a9, 0xf4 },   // Ω
+  { 0x03b1, 0x03b1, 0xe0 },   // α
+  { 0x03b2, 0x03b2, 0xe2 },   // β
+  { 0x03b5, 0x03b5, 0xe3 },   // ε
+  { 0x03b8, 0x03b8, 0xf2 },   // θ
+  { 0x03bc, 0x03bc, 0xe4 },   // μ
+  { 0x03c0, 0x03c0, 0xf7 },   // π
+  { 0x03c1, 0x03c1, 0xe6 },   // ρ
+  { 0x03c3, 0x03c3, 0xe5 },   // σ
+  { 0x2190, 0x2190, 0x7f },   // ←
+  { 0x2192, 0x2192, 0x7e },   // →
+  { 0x221a, 0x221a, 0xe8 },   // √
+  { 0x221e, 0x221e, 0xf3 },   // ∞
+  { 0x2588, 0x2588, 0xff },   // █
+  { 0x4e07, 0x4e07, 0xfb },   // 万
+  { 0x5186, 0x5186, 0xfc },   // 円
+  { 0x5343, 0x5343, 0xfa },   // 千
+  { 0xff61, 0xff9f, 0xa1 },   // Halfwidth Katakana and punctuation.
+};
+
+static const RomRange kRomA02[] = {
+  { 0x0000, 0x007e, 0x00 },
+  { 0x00a1, 0x00a7, 0xa1 },   // ¡¢£¤¥¦§
+  { 0x00a9, 0x00ab, 0xa9 },   // ©ª«
+  { 0x00ae, 0x00ae, 0xae },   // ®
+  { 0x00b0, 0x00b3, 0xb0 },   // °±²³
+  { 0x00b5, 0x00b7, 0xb5 },   // µ¶·
+  { 0x00b9, 0x00ff, 0xb9 },   // ¹º»¼½¾¿ and accented letters À..ÿ
+  { 0x0192, 0x0192, 0xa8 },   // ƒ
+  { 0x0393, 0x0393, 0x92 },   // Γ
+  { 0x0398, 0x0398, 0x99 },   // Θ
+  { 0x03a3, 0x03a3, 0x94 },   // Σ
+  { 0x03a9, 0x03a9, 0x9a },   // Ω
+  { 0x03b1, 0x03b1, 0x90 },   // α
+  { 0x03b4, 0x03b4, 0x9b },   // δ
+  { 0x03b5, 0x03b5, 0x9e },   // ε
+  { 0x03bc, 0x03bc, 0xb5 },   // μ
+  { 0x03c0, 0x03c0, 0x93 },   // π
+  { 0x03c3, 0x03c3, 0x95 },   // σ
+  { 0x03c4, 0x03c4, 0x97 },   // τ
+  { 0x03c9, 0x03c9, 0xb8 },   // ω
+  { 0x0411, 0x0411, 0x80 },   // Б
+  { 0x0414, 0x0414, 0x81 },   // Д
+  { 0x0416, 0x0419, 0x82 },   // ЖЗИЙ
+  { 0x041b, 0x041b, 0x86 },   // Л
+  { 0x041f, 0x041f, 0x87 },   // П
+  { 0x0423, 0x0423, 0x88 },   // У
+  { 0x0426, 0x0426, 0x89 },   // Ц
+  { 0x0427, 0x042b, 0x8a },   // ЧШЩЪЫ
+  { 0x042d, 0x042d, 0x8f },   // Э
+  { 0x042e, 0x042f, 0xac },   // ЮЯ
+  { 0x201c, 0x201c, 0x12 },   // “
+  { 0x201d, 0x201d, 0x13 },   // ”
+  { 0x2190, 0x2190, 0x1b },   // ←
+  { 0x2191, 0x2191, 0x18 },   // ↑
+  { 0x2192, 0x2192, 0x1a },   // →
+  { 0x2193, 0x2193, 0x19 },   // ↓
+  { 0x221e, 0x221e, 0x9c },   // ∞
+  { 0x2229, 0x2229, 0x9f },   // ∩
+  { 0x2264, 0x2264, 0x1c },   // ≤
+  { 0x2265, 0x2265, 0x1d },   // ≥
+  { 0x25b2, 0x25b2, 0x1e },   // ▲
+  { 0x25b6, 0x25b6, 0x10 },   // ▶
+  { 0x25bc, 0x25bc, 0x1f },   // ▼
+  { 0x25c0, 0x25c0, 0x11 },   // ◀
+  { 0x25cf, 0x25cf, 0x16 },   // ●
+  { 0x2665, 0x2665, 0x9d },   // ♥
+  { 0x266a, 0x266a, 0x91 },   // ♪
+};
+
+// What we always assumed: ASCII and a full block as in A00.
+static const RomRange kRomAscii[] = {
+  { 0x0000, 0x007f, 0x00 },
+  { 0x2588, 0x2588, 0xff },   // █
+};
+
+static int compare_range(const void *key, const void *array_member) {
+  const uint32_t codepoint = *(const uint32_t*)key;
+  const RomRange *range = (const RomRange*)array_member;
+  if (codepoint < range->first) return -1;
+  if (codepoint > range->last) return 1;
+  return 0;
+}
+
+bool ParseCharacterRom(const char *name, CharacterRom *rom) {
+  if (strcasecmp(name, "ascii") == 0) *rom = ROM_ASCII;
+  else if (strcasecmp(name, "a00") == 0) *rom = ROM_A00;
+  else if (strcasecmp(name, "a02") == 0) *rom = ROM_A02;
+  else return false;
+  return true;
+}
+
+int FindRomCharacter(CharacterRom rom, uint32_t codepoint) {
+  const RomRange *table = kRomAscii;
+  size_t size = sizeof(kRomAscii) / sizeof(kRomAscii[0]);
+  switch (rom) {
+  case ROM_ASCII: break;
+  case ROM_A00:
+    table = kRomA00;
+    size = sizeof(kRomA00) / sizeof(kRomA00[0]);
+    break;
+  case ROM_A02:
+    table = kRomA02;
+    size = sizeof(kRomA02) / sizeof(kRomA02[0]);
+    break;
+  }
+  // All of them start with a plain ASCII range.
+  if (codepoint <= table[0].last)
+    return codepoint;
+  const RomRange *range = (const RomRange*)bsearch(&codepoint, table, size,
+                                                   sizeof(RomRange),
+                                                   compare_range);
+  if (range == NULL)
+    return -1;
+  return range->code + (codepoint - range->first);
+}
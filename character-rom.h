@@ -0,0 +1,38 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_CHARACTER_ROM_
+#define UPNP_DISPLAY_CHARACTER_ROM_
+
+#include <stdint.h>
+
+// Character ROM variants of HD44780 compatible displays. Besides ASCII,
+// they have a different selection of characters in the upper half.
+enum CharacterRom {
+  ROM_ASCII,   // Unknown. Only use ASCII (and the full block at 0xff).
+  ROM_A00,     // Japanese standard font: Katakana and some greek letters.
+  ROM_A02      // European font: mostly ISO-8859-1, some cyrillic, symbols.
+};
+
+// Parse name of ROM as given on the command line ("ascii", "a00", "a02").
+bool ParseCharacterRom(const char *name, CharacterRom *rom);
+
+// Returns the character code in the display ROM that shows the unicode
+// "codepoint", or -1 if the ROM doesn't have it.
+int FindRomCharacter(CharacterRom rom, uint32_t codepoint);
+
+#endif  // UPNP_DISPLAY_CHARACTER_ROM_
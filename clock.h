@@ -0,0 +1,56 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_CLOCK_
+#define UPNP_DISPLAY_CLOCK_
+
+#include <stdint.h>
+
+// Source of time for the display loop. Replacing it allows to run the loop
+// on simulated time, e.g. to run hours of playback in a test or benchmark
+// without waiting.
+class Clock {
+public:
+  virtual ~Clock() {}
+
+  // Monotonic time in milliseconds. The epoch is arbitrary.
+  virtual int64_t NowMillis() = 0;
+
+  // Wait the given time.
+  virtual void SleepMillis(int millis) = 0;
+};
+
+// Clock using CLOCK_MONOTONIC and actually sleeping. Thread safe.
+class RealClock : public Clock {
+public:
+  virtual int64_t NowMillis();
+  virtual void SleepMillis(int millis);
+};
+
+// Simulated time: sleeping just advances the time and returns immediately.
+class VirtualClock : public Clock {
+public:
+  explicit VirtualClock(int64_t start_millis = 0) : now_(start_millis) {}
+
+  virtual int64_t NowMillis() { return now_; }
+  virtual void SleepMillis(int millis) { now_ += millis; }
+
+private:
+  int64_t now_;
+};
+
+#endif  // UPNP_DISPLAY_CLOCK_
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "clock.h"
 #include "observer.h"
 #include "renderer-state.h"
 
@@ -31,18 +32,29 @@
 static const char kMediaRendererDevicePrefix[] =
   "urn:schemas-upnp-org:device:MediaRenderer:";
 
+// How often the poll thread checks if a renderer's position is due for a
+// poll. The position tracker decides when that is; this only bounds how
+// late the poll can be.
+static const int kPositionPollCheckMillis = 250;
+
+static void PrintAll(const std::vector<Printer*> &printers,
+                     int line, const std::string &text) {
+  for (size_t i = 0; i < printers.size(); ++i) {
+    printers[i]->Print(line, text);
+  }
+}
+
 ControllerState::ControllerState(const char *interface_name,
-                                 ControllerObserver *observer,
-                                 Printer *printer, FILE *logstream)
-  : observer_(observer), logstream_(logstream) {
-  assert(observer != NULL);  // without, it wouldn't make much sense.
+                                 const std::vector<Printer*> &printers,
+                                 Clock *clock, FILE *logstream)
+  : clock_(clock), logstream_(logstream), quit_(false) {
   pthread_mutex_init(&mutex_, NULL);
   char buffer[40];
 
   snprintf(buffer, sizeof(buffer), "Interface: %s",
            interface_name ? interface_name : "any");
-  printer->Print(0, "Network connect.");
-  printer->Print(1, buffer);
+  PrintAll(printers, 0, "Network connect.");
+  PrintAll(printers, 1, buffer);
 
   int rc = UpnpInit2(interface_name, 0);
   int retries_left = 60;
@@ -53,7 +65,7 @@ ControllerState::ControllerState(const char *interface_name,
   while (rc != UPNP_E_SUCCESS && retries_left--) {
     usleep(kRetryTimeMs * 1000);
     snprintf(buffer, sizeof(buffer), "Network...%d", retries_left);
-    printer->Print(0, buffer);
+    PrintAll(printers, 0, buffer);
     fprintf(logstream, "UpnpInit2() Error: %s (%d). Retrying...(%ds)",
             UpnpGetErrorMessage(rc), rc, retries_left);
     rc = UpnpInit2(interface_name, 0);
@@ -64,15 +76,56 @@ ControllerState::ControllerState(const char *interface_name,
     snprintf(buffer, sizeof(buffer), "%s:%d",
              UpnpGetServerIpAddress(),
              UpnpGetServerPort());
-    printer->Print(0, buffer);
+    PrintAll(printers, 0, buffer);
     if (UpnpGetServerIp6Address() && *UpnpGetServerIp6Address()) {
       snprintf(buffer, sizeof(buffer), "%s:%d",
                UpnpGetServerIp6Address(),
                UpnpGetServerPort6());
-      printer->Print(1, buffer);
+      PrintAll(printers, 1, buffer);
     }
   }
   UpnpRegisterClient(&UpnpEventHandler, this, &device_);
+  pthread_create(&poll_thread_, NULL, &RunPositionPolls, this);
+}
+
+ControllerState::~ControllerState() {
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_mutex_unlock(&mutex_);
+  pthread_join(poll_thread_, NULL);
+}
+
+void *ControllerState::RunPositionPolls(void *userdata) {
+  static_cast<ControllerState*>(userdata)->PollPositions();
+  return NULL;
+}
+
+void ControllerState::PollPositions() {
+  for (;;) {
+    pthread_mutex_lock(&mutex_);
+    if (quit_) {
+      pthread_mutex_unlock(&mutex_);
+      return;
+    }
+    // Renderers are only deleted with the mutex held, so they stay valid.
+    for (RenderMap::const_iterator it = uuid2render_.begin();
+         it != uuid2render_.end(); ++it) {
+      if (it->second != NULL) it->second->PollPositionIfDue();
+    }
+    pthread_mutex_unlock(&mutex_);
+    clock_->SleepMillis(kPositionPollCheckMillis);
+  }
+}
+
+void ControllerState::AddObserver(ControllerObserver *observer) {
+  assert(observer != NULL);
+  pthread_mutex_lock(&mutex_);
+  observers_.push_back(observer);
+  for (RenderMap::const_iterator it = uuid2render_.begin();
+       it != uuid2render_.end(); ++it) {
+    observer->AddRenderer(it->first, it->second);
+  }
+  pthread_mutex_unlock(&mutex_);
 }
 
 static bool prefixMatch(const char *str, const char *prefix) {
@@ -91,12 +144,14 @@ void ControllerState::Register(const UpnpDiscovery *discovery) {
   renderer = uuid2render_[uuid];
   if (renderer == NULL) {
     renderer = new RendererState(UpnpDiscovery_get_Location_cstr(discovery),
-                                 logstream_);
+                                 clock_, logstream_);
     uuid2render_[uuid] = renderer;
     if (renderer->InitDescription(UpnpDiscovery_get_Location_cstr(discovery))) {
       renderer->SubscribeTo(device_, &subscription2render_);
     }
-    observer_->AddRenderer(uuid, renderer);
+    for (size_t i = 0; i < observers_.size(); ++i) {
+      observers_[i]->AddRenderer(uuid, renderer);
+    }
   }
   pthread_mutex_unlock(&mutex_);
 }
@@ -107,7 +162,9 @@ void ControllerState::Unregister(const UpnpDiscovery *discovery) {
   pthread_mutex_lock(&mutex_);
   RenderMap::iterator found = uuid2render_.find(uuid);
   if (found != uuid2render_.end()) {
-    observer_->RemoveRenderer(uuid);
+    for (size_t i = 0; i < observers_.size(); ++i) {
+      observers_[i]->RemoveRenderer(uuid);
+    }
     delete found->second;
     uuid2render_.erase(uuid);
   }
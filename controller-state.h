@@ -23,17 +23,28 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 #include "printer.h"
 
+class Clock;
 class ControllerObserver;
 class RendererState;
 
+// Discovers renderers and subscribes to their events. There is only one
+// subscription per renderer, no matter how many observers there are.
 class ControllerState {
 public:
+  // Connect to the network on given interface (NULL: any). Progress is
+  // shown on all "printers". Renderers use "clock" (not owned).
   ControllerState(const char *interface_name,
-                  ControllerObserver *observer, Printer *printer,
-                  FILE *logstream);
+                  const std::vector<Printer*> &printers,
+                  Clock *clock, FILE *logstream);
+  ~ControllerState();
+
+  // Add an observer (not owned). It is immediately told about all
+  // renderers already known.
+  void AddObserver(ControllerObserver *observer);
 
 private:
   void Register(const UpnpDiscovery *discovery);
@@ -44,14 +55,23 @@ private:
   static int UpnpEventHandler(Upnp_EventType_e event, const void *event_data,
                               void *userdata);
 
-  ControllerObserver *const observer_;
+  // Poll thread: regularly gives each renderer the chance to poll its
+  // playback position, so that the display update doesn't have to.
+  static void *RunPositionPolls(void *userdata);
+  void PollPositions();
+
+  Clock *const clock_;
   FILE *const logstream_;
 
   UpnpClient_Handle device_;
   pthread_mutex_t mutex_;
+  std::vector<ControllerObserver*> observers_;
   typedef std::map<std::string, RendererState *> RenderMap;
   RenderMap uuid2render_;
   RenderMap subscription2render_;
+
+  pthread_t poll_thread_;
+  bool quit_;                   // Protected by mutex_.
 };
 
 #endif  // UPNP_DISPLAY_CONTROLLER_STATE_
@@ -22,13 +22,21 @@
 #include <stdint.h>
 
 // Fixed font. Defined in font-data.c, that is generated from public domain
-// font 5x8.bdf
-struct Font5x8 {
-  uint32_t codepoint;
-  uint8_t bitmap[8];
-};
+// font 5x8.bdf. Use the accessors in font.h instead of these directly.
 
-extern const struct Font5x8 kFontData[];
-extern const int kFontDataSize;
+// 5 bytes per glyph: 8 rows of 5 pixels, first row in the most significant
+// bits of the first byte, leftmost pixel first.
+extern const unsigned char kFontGlyphs[];
+extern const int kFontGlyphCount;
+
+// For each page of 64 codepoints in the BMP, the page number + 1 in the
+// following (0: no glyphs in page). Each page has a bitmap of codepoints
+// with a glyph (bit 0 of byte 0: first codepoint), for each byte of the
+// bitmap the number of glyphs in the page before it, and the index of
+// its first glyph.
+extern const unsigned char kFontPageIndex[1024];
+extern const unsigned char kFontPagePresent[][8];
+extern const unsigned char kFontPageRank[][8];
+extern const unsigned short kFontPageFirstGlyph[];
 
 #endif  // FONT_DATA_H
@@ -0,0 +1,155 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "font.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "font-data.h"
+
+// The tables of the font in use; see font-data.h.
+struct FontTables {
+  const unsigned char *page_index;
+  const unsigned char (*page_present)[8];
+  const unsigned char (*page_rank)[8];
+  const uint16_t *page_first_glyph;
+  const unsigned char *glyphs;
+};
+
+// Start of a font file. Numbers are little endian; a big endian machine
+// reads the wrong version and rejects the file.
+struct FontFileHeader {
+  char magic[8];
+  uint16_t version;
+  uint16_t pages;
+  uint32_t glyphs;
+};
+
+static const char kFontFileMagic[] = "UPNPLCDF";
+static const int kFontFileVersion = 2;
+
+static FontTables font = {
+  kFontPageIndex, kFontPagePresent, kFontPageRank, kFontPageFirstGlyph,
+  kFontGlyphs
+};
+
+// Number of bits set in each byte. A table, as the CPUs we run on have no
+// population count instruction.
+#define B2(n) n, n + 1, n + 1, n + 2
+#define B4(n) B2(n), B2(n + 1), B2(n + 1), B2(n + 2)
+#define B6(n) B4(n), B4(n + 1), B4(n + 1), B4(n + 2)
+static const unsigned char kBitsSet[256] = { B6(0), B6(1), B6(1), B6(2) };
+#undef B6
+#undef B4
+#undef B2
+
+// Check that the tables of a font file only refer to what is there.
+static bool ValidTables(const FontTables &t, int pages, int glyphs) {
+  for (int p = 0; p < 1024; ++p) {
+    if (t.page_index[p] > pages) return false;
+  }
+  for (int p = 0; p < pages; ++p) {
+    int rank = 0;
+    for (int k = 0; k < 8; ++k) {
+      if (t.page_rank[p][k] != rank) return false;
+      rank += kBitsSet[t.page_present[p][k]];
+    }
+    if (t.page_first_glyph[p] + rank > glyphs) return false;
+  }
+  return true;
+}
+
+bool FontLoadFile(const char *filename, std::string *error) {
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    *error = strerror(errno);
+    return false;
+  }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(FontFileHeader)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);  // The mapping stays valid.
+  if (map == MAP_FAILED) {
+    *error = "Can't map font file";
+    return false;
+  }
+
+  const FontFileHeader *header = (const FontFileHeader*) map;
+  const int pages = header->pages;
+  const int glyphs = header->glyphs;
+  const char *data = (const char*) map + sizeof(FontFileHeader);
+  FontTables tables;
+  tables.page_present = (const unsigned char (*)[8]) data;
+  tables.page_rank = (const unsigned char (*)[8]) (data + 8 * pages);
+  tables.page_first_glyph = (const uint16_t*) (data + 16 * pages);
+  tables.page_index = (const unsigned char*) (data + 18 * pages);
+  tables.glyphs = tables.page_index + 1024;
+  if (memcmp(header->magic, kFontFileMagic, sizeof(header->magic)) != 0
+      || header->version != kFontFileVersion) {
+    *error = "Not a font file";
+  } else if (st.st_size != (off_t)(sizeof(FontFileHeader) + 18 * pages
+                                    + 1024 + 5 * glyphs)
+             || !ValidTables(tables, pages, glyphs)) {
+    *error = "Font file is corrupt";
+  } else {
+    font = tables;
+    return true;
+  }
+  munmap(map, st.st_size);
+  return false;
+}
+
+// Index of the glyph in font.glyphs or -1. Only table lookups: this runs
+// for every cell not in the display ROM in each frame.
+static int FindGlyph(uint32_t codepoint) {
+  if (codepoint >= 0x10000) return -1;
+  const int page = font.page_index[codepoint >> 6];
+  if (page == 0) return -1;
+  const int byte = (codepoint >> 3) & 0x7;
+  const unsigned char present = font.page_present[page - 1][byte];
+  const unsigned char bit = 1 << (codepoint & 0x7);
+  if ((present & bit) == 0) return -1;
+  return (font.page_first_glyph[page - 1] + font.page_rank[page - 1][byte]
+          + kBitsSet[present & (bit - 1)]);
+}
+
+bool FontHasGlyph(uint32_t codepoint) {
+  return FindGlyph(codepoint) >= 0;
+}
+
+bool FontGetGlyph(uint32_t codepoint, uint8_t rows[8]) {
+  const int index = FindGlyph(codepoint);
+  if (index < 0) {
+    memset(rows, 0, 8);
+    return false;
+  }
+  const unsigned char *packed = font.glyphs + 5 * index;
+  uint64_t bits = 0;
+  for (int i = 0; i < 5; ++i) bits = (bits << 8) | packed[i];
+  for (int i = 0; i < 8; ++i) {
+    rows[i] = (bits >> (35 - 5 * i)) & 0x1f;
+  }
+  return true;
+}
@@ -0,0 +1,39 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_FONT_
+#define UPNP_DISPLAY_FONT_
+
+#include <stdint.h>
+
+#include <string>
+
+// Use the font in "filename", as generated by font/font2c.awk with
+// -v binary=1, instead of the built-in one. The file is mapped into
+// memory, so glyphs are only read from disk when used. Call before any
+// other function here is used by another thread. Returns 'false' with a
+// message in "error" if the file can't be used; the font is unchanged then.
+bool FontLoadFile(const char *filename, std::string *error);
+
+// Returns 'true' if our 5x8 font has a glyph for "codepoint".
+bool FontHasGlyph(uint32_t codepoint);
+
+// Get the glyph of "codepoint" as 8 rows of 5 pixels, leftmost pixel in
+// bit 4. Returns 'false', with empty rows, if there is no glyph.
+bool FontGetGlyph(uint32_t codepoint, uint8_t rows[8]);
+
+#endif  // UPNP_DISPLAY_FONT_
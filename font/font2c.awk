@@ -1,30 +1,171 @@
-# To be executed with awk.
-# Generates a data file out of a BDF font file.
+# To be executed with awk, after font/page-index.awk:
+#   awk -f font/page-index.awk -f font/font2c.awk < font.bdf
+# Generates a data file out of a BDF font file with 5x8 glyphs: C source
+# by default, or with -v binary=1 a font file to be loaded with -F. For
+# the binary output, run awk with LC_ALL=C, otherwise some awks write
+# bytes above 127 as UTF-8.
+#
+# Each glyph is stored as 8 rows of 5 bits, packed into 5 bytes, most
+# significant bit first. Glyphs are found with a two level index: the
+# codepoint selects one of 1024 pages of 64 codepoints in the BMP. Each
+# page that has glyphs has a bitmap of the codepoints present (8 bytes,
+# bit 0 of the first byte is the first codepoint), the index of its first
+# glyph and, for each byte of the bitmap, the number of glyphs in the page
+# before it. The glyph index of a codepoint is the sum of these two plus
+# the number of bits set below the codepoint's bit in its byte.
+#
+# The font file has the same tables, all numbers little endian:
+#   "UPNPLCDF", uint16 version (2), uint16 pages, uint32 glyphs,
+#   uint8 bitmap[pages][8], uint8 rank[pages][8], uint16 first
+#   glyph[pages], uint8 page index[1024], packed glyphs[glyphs * 5].
 BEGIN {
     count = 0;
-    print("// Generated code. Do not edit.");
-    print("#include \"font-data.h\"");
-    print;
-    print("const struct Font5x8 kFontData[] = {");
+}
+
+function hex2num(hex,    i, result) {
+    result = 0;
+    hex = toupper(hex);
+    for (i = 1; i <= length(hex); ++i) {
+        result = result * 16 + index("0123456789ABCDEF", substr(hex, i, 1)) - 1;
+    }
+    return result;
+}
+
+function fail(message) {
+    printf("U+%04X: %s\n", enc, message) > "/dev/stderr";
+    failed = 1;
+    exit 1;
+}
+
+# Byte "k" of the presence bitmap of page "p".
+function present_byte(p, k,    b, value) {
+    value = 0;
+    for (b = 7; b >= 0; --b) {
+        value = value * 2 + ((p * 64 + k * 8 + b) in present);
+    }
+    return value;
+}
+
+# Number of glyphs in page "p" before byte "k" of its bitmap.
+function page_rank(p, k,    b, rank) {
+    rank = 0;
+    for (b = 0; b < k * 8; ++b) {
+        rank += ((p * 64 + b) in present);
+    }
+    return rank;
+}
+
+# Write "value" as "bytes" bytes, little endian.
+function put_number(value, bytes,    i) {
+    for (i = 0; i < bytes; ++i) {
+        printf("%c", value % 256);
+        value = int(value / 256);
+    }
 }
 
 /^STARTCHAR/              { val=$2 }
-/^ENCODING/               { enc=$2; printf("  { %5d, {", enc); }
-/^BITMAP/                 { in_bitmap=1; byte_count=0; }
+/^ENCODING/               { enc=$2; }
+/^BITMAP/                 { in_bitmap=1; row_count=0; }
 
 /^[0-9a-fA-F][0-9a-fA-F]/ {
     if (in_bitmap) {
-	if (byte_count > 0) { printf (","); }
-	printf("0x%s", $1);
-	byte_count++;
+        row = hex2num($1);
+        if (row % 8 != 0 || row_count >= 8) fail("not a 5x8 glyph");
+        rows[row_count++] = row / 8;  # font is left aligned.
     }
 }
 
 /^ENDCHAR/                {
-    printf("}}, // U+%04X %s\n", enc, val);
-    in_bitmap=0; count++; 
+    if (row_count != 8) fail("not a 5x8 glyph");
+    if (enc < 0 || enc >= 65536) fail("outside the BMP");
+    if (count > 0 && enc <= last_enc) fail("not sorted");
+    last_enc = enc;
+    for (b = 0; b < 5; ++b) glyph[count * 5 + b] = 0;
+    for (bit = 0; bit < 40; ++bit) {
+        pixel = int(rows[int(bit / 5)] / 2 ^ (4 - bit % 5)) % 2;
+        glyph[count * 5 + int(bit / 8)] += pixel * 2 ^ (7 - bit % 8);
+    }
+    glyph_name[count] = val;
+    glyph_codepoint[count] = enc;
+    in_bitmap = 0;
+    present[enc] = 1;
+    page = int(enc / 64);
+    if (!(page in page_first)) page_first[page] = count;
+    count++;
+}
+
+function write_c(    i, p, k) {
+    print("// Generated code. Do not edit.");
+    print("#include \"font-data.h\"");
+    print("");
+    print("const unsigned char kFontGlyphs[] = {");
+    for (i = 0; i < count; ++i) {
+        printf("  0x%02x,0x%02x,0x%02x,0x%02x,0x%02x,  // U+%04X %s\n",
+               glyph[i * 5], glyph[i * 5 + 1], glyph[i * 5 + 2],
+               glyph[i * 5 + 3], glyph[i * 5 + 4],
+               glyph_codepoint[i], glyph_name[i]);
+    }
+    printf("};\nconst int kFontGlyphCount = %d;\n", count);
+
+    print("");
+    print("const unsigned char kFontPagePresent[][8] = {");
+    for (p = 0; p < 1024; ++p) {
+        if (!(p in page_first)) continue;
+        printf("  {");
+        for (k = 0; k < 8; ++k) printf(" 0x%02x,", present_byte(p, k));
+        printf(" },  // U+%04X\n", p * 64);
+    }
+    print("};");
+    print("");
+    print("const unsigned char kFontPageRank[][8] = {");
+    for (p = 0; p < 1024; ++p) {
+        if (!(p in page_first)) continue;
+        printf("  {");
+        for (k = 0; k < 8; ++k) printf(" %d,", page_rank(p, k));
+        printf(" },  // U+%04X\n", p * 64);
+    }
+    print("};");
+    print("");
+    print("const unsigned short kFontPageFirstGlyph[] = {");
+    for (p = 0; p < 1024; ++p) {
+        if (p in page_first)
+            printf("  %d,  // U+%04X\n", page_first[p], p * 64);
+    }
+    print("};");
+    print("");
+    write_page_index("kFontPageIndex", page_number);
+}
+
+function write_binary(    i, p, k) {
+    printf("UPNPLCDF");
+    put_number(2, 2);
+    put_number(pages, 2);
+    put_number(count, 4);
+    for (p = 0; p < 1024; ++p) {
+        if (!(p in page_first)) continue;
+        for (k = 0; k < 8; ++k) put_number(present_byte(p, k), 1);
+    }
+    for (p = 0; p < 1024; ++p) {
+        if (!(p in page_first)) continue;
+        for (k = 0; k < 8; ++k) put_number(page_rank(p, k), 1);
+    }
+    for (p = 0; p < 1024; ++p) {
+        if (p in page_first) put_number(page_first[p], 2);
+    }
+    for (p = 0; p < 1024; ++p) {
+        put_number((p in page_number) ? page_number[p] : 0, 1);
+    }
+    for (i = 0; i < count * 5; ++i) {
+        put_number(glyph[i], 1);
+    }
 }
 
 END {
-    printf("};\nconst int kFontDataSize = %d;\n", count);
+    if (failed) exit 1;
+    pages = number_pages(page_first, page_number);
+    if (binary) {
+        write_binary();
+    } else {
+        write_c();
+    }
 }
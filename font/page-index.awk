@@ -0,0 +1,31 @@
+# To be executed with awk, before the generator that uses it:
+#   awk -f font/page-index.awk -f font/<generator>.awk
+# The page index shared by the generated tables (font2c.awk,
+# translit2c.awk): a codepoint below 0x10000 selects one of 1024 pages of
+# 64 codepoints, and the index has the page number + 1 of each page that
+# has data, 0 for the others.
+
+# Number the pages that are in "used", in order and starting with 1, into
+# "page_number". Returns the number of pages.
+function number_pages(used, page_number,    p, pages) {
+    pages = 0;
+    for (p = 0; p < 1024; ++p) {
+        if (p in used) page_number[p] = ++pages;
+    }
+    if (pages > 255) {
+        print("Too many pages") > "/dev/stderr";
+        exit 1;
+    }
+    return pages;
+}
+
+# Write the index as C array "name".
+function write_page_index(name, page_number,    p) {
+    printf("const unsigned char %s[1024] = {\n", name);
+    for (p = 0; p < 1024; ++p) {
+        if (p % 16 == 0) printf("  ");
+        printf("%d,", (p in page_number) ? page_number[p] : 0);
+        printf((p % 16 == 15) ? "\n" : " ");
+    }
+    print("};");
+}
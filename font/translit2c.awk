@@ -0,0 +1,79 @@
+# To be executed with awk, after font/page-index.awk:
+#   awk -f font/page-index.awk -f font/translit2c.awk < translit.txt
+# Generates a two-level lookup table out of the tab separated
+# transliteration table: the codepoint (< 0x10000) selects one of 1024
+# pages of 64 codepoints; each page that has entries is an array of
+# offsets into a string pool with the replacements.
+BEGIN {
+    FS = "\t";
+    count = 0;
+    pool_size = 1;      # Offset 0 is for "no transliteration".
+}
+
+function hex2num(hex,    i, result) {
+    result = 0;
+    hex = toupper(hex);
+    for (i = 1; i <= length(hex); ++i) {
+        result = result * 16 + index("0123456789ABCDEF", substr(hex, i, 1)) - 1;
+    }
+    return result;
+}
+
+# Escape for a C string literal. Character by character, as awk
+# implementations disagree on backslashes in gsub() replacements.
+function c_escape(text,    i, c, result) {
+    result = "";
+    for (i = 1; i <= length(text); ++i) {
+        c = substr(text, i, 1);
+        if (c == "\\" || c == "\"") result = result "\\";
+        result = result c;
+    }
+    return result;
+}
+
+/^#/ || NF < 2 { next; }
+
+{
+    cp = hex2num($1);
+    if (cp >= 65536) {
+        printf("Codepoint %s out of range\n", $1) > "/dev/stderr";
+        exit 1;
+    }
+    if (!($2 in offset)) {
+        offset[$2] = pool_size;
+        pool[count++] = $2;
+        pool_size += length($2) + 1;
+    }
+    entry[cp] = offset[$2];
+    page_used[int(cp / 64)] = 1;
+}
+
+END {
+    print("// Generated code. Do not edit.");
+    print("#include \"translit-data.h\"");
+    print("");
+    print("const char kTranslitStrings[] =");
+    print("  \"\\0\"");
+    for (i = 0; i < count; ++i) {
+        printf("  \"%s\\0\"\n", c_escape(pool[i]));
+    }
+    print("  ;");
+    print("");
+
+    number_pages(page_used, page_number);
+    print("const unsigned short kTranslitPages[][64] = {");
+    for (p = 0; p < 1024; ++p) {
+        if (!(p in page_used)) continue;
+        printf("  {  // U+%04X\n   ", p * 64);
+        for (i = 0; i < 64; ++i) {
+            cp = p * 64 + i;
+            printf(" %d,", (cp in entry) ? entry[cp] : 0);
+            if (i % 16 == 15) printf("\n   ");
+        }
+        print("},");
+    }
+    print("};");
+    print("");
+
+    write_page_index("kTranslitPageIndex", page_number);
+}
@@ -0,0 +1,152 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "frame.h"
+
+#include <assert.h>
+
+#include "utf8.h"
+
+// Encode codepoint as UTF-8 into "out" (at least 4 bytes). Returns length.
+static int EncodeUtf8(Frame::Codepoint cp, char *out) {
+  if (cp < 0x80) {
+    out[0] = cp;
+    return 1;
+  } else if (cp < 0x800) {
+    out[0] = 0xC0 | (cp >> 6);
+    out[1] = 0x80 | (cp & 0x3F);
+    return 2;
+  } else if (cp < 0x10000) {
+    out[0] = 0xE0 | (cp >> 12);
+    out[1] = 0x80 | ((cp >> 6) & 0x3F);
+    out[2] = 0x80 | (cp & 0x3F);
+    return 3;
+  }
+  out[0] = 0xF0 | ((cp >> 18) & 0x07);
+  out[1] = 0x80 | ((cp >> 12) & 0x3F);
+  out[2] = 0x80 | ((cp >> 6) & 0x3F);
+  out[3] = 0x80 | (cp & 0x3F);
+  return 4;
+}
+
+Frame::Frame(int width, int height) {
+  Reset(width, height);
+}
+
+void Frame::Reset(int width, int height) {
+  assert(width >= 0 && width <= kMaxWidth);
+  assert(height >= 0 && height <= kMaxHeight);
+  width_ = width;
+  height_ = height;
+  for (int row = 0; row < kMaxHeight; ++row) {
+    for (int col = 0; col < kMaxWidth; ++col) {
+      cells_[row][col] = ' ';
+    }
+  }
+  ClearPixelShifts();
+}
+
+void Frame::SetPixelShift(int row, int begin, int end, int pixels,
+                          Codepoint entering) {
+  assert(row >= 0 && row < height_);
+  assert(begin >= 0 && begin <= end && end <= width_);
+  PixelShift &shift = shift_[row];
+  shift.begin = begin;
+  shift.end = end;
+  shift.pixels = (begin < end) ? pixels : 0;
+  shift.entering = entering;
+}
+
+void Frame::ClearPixelShifts() {
+  const PixelShift none = { 0, 0, 0, ' ' };
+  for (int row = 0; row < kMaxHeight; ++row) {
+    shift_[row] = none;
+  }
+}
+
+void Frame::SetLine(int row, const LineBuffer &text) {
+  assert(row >= 0 && row < height_);
+  const char *it = text.data();
+  const char *const end = it + text.size();
+  int col = 0;
+  while (col < width_ && it < end) {
+    cells_[row][col++] = utf8_next_codepoint(it);
+  }
+  while (col < width_) {
+    cells_[row][col++] = ' ';
+  }
+  const PixelShift none = { 0, 0, 0, ' ' };
+  shift_[row] = none;
+}
+
+void Frame::GetLine(int row, LineBuffer *text) const {
+  assert(row >= 0 && row < height_);
+  int len = width_;
+  while (len > 0 && cells_[row][len - 1] == ' ') --len;
+  text->Clear();
+  char buf[4];
+  for (int col = 0; col < len; ++col) {
+    const int bytes = EncodeUtf8(cells_[row][col], buf);
+    text->Append(buf, buf + bytes);
+  }
+}
+
+int Frame::Diff(const Frame &other, Span *spans) const {
+  assert(width_ == other.width_ && height_ == other.height_);
+  int count = 0;
+  for (int row = 0; row < height_; ++row) {
+    const Codepoint *a = cells_[row];
+    const Codepoint *b = other.cells_[row];
+
+    // Cells of a changed pixel shift are dirty, even if the same codepoint.
+    int forced_begin = 0, forced_end = 0;
+    const PixelShift &sa = shift_[row];
+    const PixelShift &sb = other.shift_[row];
+    if ((sa.pixels > 0 || sb.pixels > 0)
+        && (sa.pixels != sb.pixels || sa.begin != sb.begin
+            || sa.end != sb.end || sa.entering != sb.entering)) {
+      forced_begin = width_;
+      if (sa.pixels > 0) {
+        forced_begin = sa.begin;
+        forced_end = sa.end;
+      }
+      if (sb.pixels > 0) {
+        if (sb.begin < forced_begin) forced_begin = sb.begin;
+        if (sb.end > forced_end) forced_end = sb.end;
+      }
+    }
+
+    int col = 0;
+    while (col < width_) {
+      if (a[col] == b[col] && (col < forced_begin || col >= forced_end)) {
+        ++col;
+        continue;
+      }
+      Span &span = spans[count++];
+      span.row = row;
+      span.begin = col;
+      while (col < width_
+             && (a[col] != b[col]
+                 || (col >= forced_begin && col < forced_end))) {
+        ++col;
+      }
+      span.end = col;
+    }
+  }
+  return count;
+}
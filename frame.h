@@ -0,0 +1,103 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_FRAME_
+#define UPNP_DISPLAY_FRAME_
+
+#include <stdint.h>
+
+#include "line-buffer.h"
+
+// Content of a whole display: a fixed grid of codepoints. Frames are
+// composed completely and then handed to the Printer at once, so that the
+// display never shows half-updated content and change detection is done
+// in one place (see Printer::SubmitFrame()).
+//
+// Fixed size storage, so copying and modifying does not allocate.
+class Frame {
+public:
+  typedef uint32_t Codepoint;
+
+  static const int kMaxHeight = 4;
+  static const int kMaxWidth = LineBuffer::kMaxWidth;
+
+  // Private use codepoints for progress bar cells: kProgressBar + n is a
+  // cell with the left n of 5 pixel columns filled (n = 0..5).
+  static const Codepoint kProgressBar = 0xE000;
+  static const int kProgressBarSteps = 5;
+
+  // A range of changed cells [begin, end) in a row.
+  struct Span {
+    int row;
+    int begin;
+    int end;
+  };
+
+  // For smooth scrolling: cells [begin, end) of a row are shown moved left
+  // by "pixels" pixel columns (out of the 5 of a character); the gap at
+  // the right end is filled with the "entering" codepoint. Pixels = 0 is
+  // regular display.
+  struct PixelShift {
+    int begin;
+    int end;
+    int pixels;
+    Codepoint entering;
+  };
+
+  // Create frame of given size filled with spaces.
+  explicit Frame(int width = kMaxWidth, int height = kMaxHeight);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  // Change size and fill with spaces.
+  void Reset(int width, int height);
+
+  Codepoint at(int row, int col) const { return cells_[row][col]; }
+  void set(int row, int col, Codepoint cp) { cells_[row][col] = cp; }
+
+  // Set the row from UTF-8 text; truncated or padded with spaces to width.
+  // Resets the pixel shift of the row.
+  void SetLine(int row, const LineBuffer &text);
+
+  // Pixel shift of a row. Printers that can't shift pixels show the
+  // unshifted cells.
+  void SetPixelShift(int row, int begin, int end, int pixels,
+                     Codepoint entering);
+  void ClearPixelShifts();
+  const PixelShift &pixel_shift(int row) const { return shift_[row]; }
+
+  // Get row as UTF-8 text; trailing spaces are removed.
+  void GetLine(int row, LineBuffer *text) const;
+
+  // Compare with "other" (which must be of the same size) and store the
+  // cell ranges that differ in "spans" (room for MaxSpans() entries).
+  // If the pixel shift of a row changed, all cells it covers differ.
+  // Returns number of spans.
+  int Diff(const Frame &other, Span *spans) const;
+
+  // Maximum number of spans Diff() can return: every other cell.
+  static int MaxSpans() { return kMaxHeight * ((kMaxWidth + 1) / 2); }
+
+private:
+  int width_;
+  int height_;
+  Codepoint cells_[kMaxHeight][kMaxWidth];
+  PixelShift shift_[kMaxHeight];
+};
+
+#endif  // UPNP_DISPLAY_FRAME_
@@ -1,187 +1,96 @@
 // -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
 #include "gpio.h"
 
-#define BCM2708_PERI_BASE        0x20000000
-#define BCM2709_PERI_BASE        0x3F000000
-#define BCM2711_PERI_BASE        0xFE000000
+#include <time.h>
 
-#define GPIO_REGISTER_OFFSET     0x200000
+#include <algorithm>
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <fcntl.h>
-#include <sys/mman.h>
-#include <unistd.h>
+// Recalibrate busy waiting this often.
+#define BUSY_WAIT_RECALIBRATE_SECONDS 10
 
-#define REGISTER_BLOCK_SIZE (4*1024)
+// Before calibrating, spin this long to give the CPU frequency governor a
+// chance to clock up, as it does while we are writing to the display.
+#define BUSY_WAIT_WARMUP_NANOS 2000000
 
-// GPIO setup macros. Always use INP_GPIO(x) before using OUT_GPIO(x) or SET_GPIO_ALT(x,y)
-#define INP_GPIO(g) *(gpio_port_+((g)/10)) &= ~(7<<(((g)%10)*3))
-#define OUT_GPIO(g) *(gpio_port_+((g)/10)) |=  (1<<(((g)%10)*3))
-#define SET_GPIO_ALT(g,a) *(gpio+(((g)/10))) |= (((a)<=3?(a)+4:(a)==4?3:2)<<(((g)%10)*3))
+// Calibrate with a loop that takes at least this long.
+#define BUSY_WAIT_CALIBRATE_NANOS 20000
 
-#define GPIO_SET *(gpio+7)  // sets   bits which are 1 ignores bits which are 0
-#define GPIO_CLR *(gpio+10) // clears bits which are 1 ignores bits which are 0
-
-/*static*/ const uint32_t GPIO::kValidBits
-= ((1 <<  2) | (1 <<  3) | (1 <<  4) | (1 <<  7)| (1 << 8) | (1 <<  9) |
-   (1 << 10) | (1 << 11) | (1 << 14) | (1 << 15)| (1 <<17) | (1 << 18)|
-   (1 << 22) | (1 << 23) | (1 << 24) | (1 << 25)| (1 << 27));
-
-enum RaspberryPiModel {
-  PI_MODEL_1,
-  PI_MODEL_2,
-  PI_MODEL_3,
-  PI_MODEL_4
-};
-
-static int ReadFileToBuffer(char *buffer, size_t size, const char *filename) {
-  const int fd = open(filename, O_RDONLY);
-  if (fd < 0) return -1;
-  ssize_t r = read(fd, buffer, size - 1); // assume one read enough
-  buffer[r >= 0 ? r : 0] = '\0';
-  close(fd);
-  return r;
-}
-
-static RaspberryPiModel DetermineRaspberryModel() {
-  char buffer[4096];
-  if (ReadFileToBuffer(buffer, sizeof(buffer), "/proc/cpuinfo") < 0) {
-    fprintf(stderr, "Reading cpuinfo: Could not determine Pi model\n");
-    return PI_MODEL_3;  // safe guess fallback.
-  }
-  static const char RevisionTag[] = "Revision";
-  const char *revision_key;
-  if ((revision_key = strstr(buffer, RevisionTag)) == NULL) {
-    fprintf(stderr, "non-existent Revision: Could not determine Pi model\n");
-    return PI_MODEL_3;
-  }
-  unsigned int pi_revision;
-  if (sscanf(index(revision_key, ':') + 1, "%x", &pi_revision) != 1) {
-    fprintf(stderr, "Unknown Revision: Could not determine Pi model\n");
-    return PI_MODEL_3;
-  }
-
-  // https://www.raspberrypi.org/documentation/hardware/raspberrypi/revision-codes/README.md
-  const unsigned pi_type = (pi_revision >> 4) & 0xff;
-  switch (pi_type) {
-  case 0x00: /* A */
-  case 0x01: /* B, Compute Module 1 */
-  case 0x02: /* A+ */
-  case 0x03: /* B+ */
-  case 0x05: /* Alpha ?*/
-  case 0x06: /* Compute Module1 */
-  case 0x09: /* Zero */
-  case 0x0c: /* Zero W */
-    return PI_MODEL_1;
-
-  case 0x04:  /* Pi 2 */
-    return PI_MODEL_2;
-
-  case 0x11: /* Pi 4 */
-    return PI_MODEL_4;
-
-  default:  /* a bunch of versions represneting Pi 3 */
-    return PI_MODEL_3;
-  }
+static int64_t MonotonicRawNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-static volatile uint32_t *mmap_bcm_register(off_t register_offset) {
-  off_t base = BCM2709_PERI_BASE;  // safe fallback guess.
-  switch (DetermineRaspberryModel()) {
-  case PI_MODEL_1: base = BCM2708_PERI_BASE; break;
-  case PI_MODEL_2: base = BCM2709_PERI_BASE; break;
-  case PI_MODEL_3: base = BCM2709_PERI_BASE; break;
-  case PI_MODEL_4: base = BCM2711_PERI_BASE; break;
-  }
-
-  int mem_fd = open("/dev/gpiomem", O_RDWR|O_SYNC);
-  if (mem_fd < 0) {
-    // Try fallback to old-school way.
-    mem_fd = open("/dev/mem", O_RDWR|O_SYNC);
-  }
-  if (mem_fd < 0)
-    return NULL;
-
-  uint32_t *result =
-    (uint32_t*) mmap(NULL,                  // Any adddress in our space will do
-                     REGISTER_BLOCK_SIZE,   // Map length
-                     PROT_READ|PROT_WRITE,  // Enable r/w on GPIO registers.
-                     MAP_SHARED,
-                     mem_fd,                // File to map
-                     base + register_offset // Offset to bcm register
-                     );
-  close(mem_fd);
-
-  if (result == MAP_FAILED) {
-    perror("mmap error: ");
-    fprintf(stderr, "MMapping from base 0x%lx, offset 0x%lx\n",
-            (long)base, (long)register_offset);
-    return NULL;
+// The loop of busy_nano_sleep(). Not inlined, so that we measure the same
+// code as is used.
+static void __attribute__((noinline)) SpinLoop(uint32_t loops) {
+  for (uint32_t i = loops; i != 0; --i) {
+    asm("");
   }
-  return result;
 }
 
-static void busy_wait_nanos_rpi_1(long nanos) {
-  if (nanos < 70) return;
-  // The following loop is determined empirically on a 700Mhz RPi
-  for (uint32_t i = (nanos - 70) >> 2; i != 0; --i) {
-    asm("nop");
+// Shortest of a few runs of the loop including two clock reads, so that
+// being interrupted or preempted doesn't count.
+static int64_t MinSpinNanos(uint32_t loops) {
+  int64_t best = -1;
+  for (int i = 0; i < 5; ++i) {
+    const int64_t start = MonotonicRawNanos();
+    SpinLoop(loops);
+    const int64_t duration = MonotonicRawNanos() - start;
+    if (best < 0 || duration < best) best = duration;
   }
+  return best;
 }
 
-static void busy_wait_nanos_rpi_2(long nanos) {
-  if (nanos < 20) return;
-  // The following loop is determined empirically on a 900Mhz RPi 2
-  for (uint32_t i = (nanos - 20) * 100 / 110; i != 0; --i) {
-    asm("");
-  }
+GPIO::GPIO()
+  : calibration_count_(0), last_calibration_nanos_(0) {
+  // Until calibrated, assume a (too) fast CPU: waits are longer, not shorter.
+  calibration_.loops_per_usec = 10000;
+  calibration_.overhead_nanos = 0;
 }
 
-static void busy_wait_nanos_rpi_3(long nanos) {
-  if (nanos < 20) return;
-  for (uint32_t i = (nanos - 15) * 100 / 73; i != 0; --i) {
-    asm("");
-  }
+void GPIO::busy_nano_sleep(long nanos) {
+  if (nanos <= (long)calibration_.overhead_nanos) return;
+  SpinLoop((uint64_t)(nanos - calibration_.overhead_nanos)
+           * calibration_.loops_per_usec / 1000);
 }
 
-static void busy_wait_nanos_rpi_4(long nanos) {
-  if (nanos < 20) return;
-  // Interesting, the Pi4 is _slower_ than the Pi3 ? At least for this busy loop
-  for (uint32_t i = (nanos - 5) * 100 / 132; i != 0; --i) {
-    asm("");
+void GPIO::CalibrateBusyWait() {
+  int64_t start = MonotonicRawNanos();
+  while (MonotonicRawNanos() - start < BUSY_WAIT_WARMUP_NANOS) {
+    SpinLoop(1000);
   }
-}
-
-// -- public interface
-GPIO::GPIO() : output_bits_(0), gpio_port_(NULL) {
-}
 
-uint32_t GPIO::InitOutputs(uint32_t outputs) {
-  if (gpio_port_ == NULL) {
-    fprintf(stderr, "Attempt to init outputs but initialized.\n");
-    return 0;
+  // Clock reads alone, the call, and enough loops to be long compared to
+  // these, with the time of the loops in between.
+  start = MonotonicRawNanos();
+  const int64_t clock_nanos = MonotonicRawNanos() - start;
+  const int64_t call_nanos = MinSpinNanos(0);
+  uint32_t loops = 1000;
+  int64_t loop_nanos;
+  while ((loop_nanos = MinSpinNanos(loops) - call_nanos)
+         < BUSY_WAIT_CALIBRATE_NANOS && loops < (1U << 30)) {
+    loops *= 2;
   }
-  outputs &= kValidBits;   // Sanitize input.
-  output_bits_ = outputs;
-  for (uint32_t b = 0; b < 27; ++b) {
-    if (outputs & (1 << b)) {
-      INP_GPIO(b);   // for writing, we first need to set as input.
-      OUT_GPIO(b);
+  if (loop_nanos > 0) {
+    measured_loops_per_usec_[calibration_count_++ % kCalibrationHistory]
+      = (uint64_t)loops * 1000 / loop_nanos;
+    const int history = (calibration_count_ < kCalibrationHistory
+                         ? calibration_count_ : kCalibrationHistory);
+    calibration_.loops_per_usec = 0;
+    for (int i = 0; i < history; ++i) {
+      calibration_.loops_per_usec = std::max(calibration_.loops_per_usec,
+                                             measured_loops_per_usec_[i]);
     }
   }
-  return output_bits_;
+  calibration_.overhead_nanos = (call_nanos > clock_nanos
+                                 ? call_nanos - clock_nanos : 0);
+  last_calibration_nanos_ = MonotonicRawNanos();
 }
 
-bool GPIO::Init() {
-  const RaspberryPiModel model = DetermineRaspberryModel();
-  gpio_port_ = mmap_bcm_register(GPIO_REGISTER_OFFSET);
-  switch (model) {
-  case PI_MODEL_1: busy_wait_impl_ = busy_wait_nanos_rpi_1; break;
-  case PI_MODEL_2: busy_wait_impl_ = busy_wait_nanos_rpi_2; break;
-  case PI_MODEL_3: busy_wait_impl_ = busy_wait_nanos_rpi_3; break;
-  case PI_MODEL_4: busy_wait_impl_ = busy_wait_nanos_rpi_4; break;
+void GPIO::RecalibrateIfDue() {
+  if (MonotonicRawNanos() - last_calibration_nanos_
+      > (int64_t)BUSY_WAIT_RECALIBRATE_SECONDS * 1000000000) {
+    CalibrateBusyWait();
   }
-  return gpio_port_ != NULL;
 }
@@ -1,50 +1,72 @@
 // -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
-#ifndef RPI_GPIO_H
-#define RPI_GPIO_H
+#ifndef UPNP_DISPLAY_GPIO_H
+#define UPNP_DISPLAY_GPIO_H
 
 #include <stdint.h>
 
-// For now, everything is initialized as output.
+// Interface to general purpose IO pins, one bit per pin. Implemented by
+// the Raspberry Pi registers (RPiGPIO) and by a simulation (SimGPIO).
 class GPIO {
  public:
-  // Available bits that actually have pins.
-  static const uint32_t kValidBits;
-
   GPIO();
+  virtual ~GPIO() {}
 
   // Initialize before use. Returns 'true' if successful, 'false' otherwise
   // (e.g. due to a permission problem).
-  bool Init();
+  virtual bool Init() = 0;
 
   // Initialize outputs.
   // Returns the bits that are actually set.
-  uint32_t InitOutputs(uint32_t outputs);
+  virtual uint32_t InitOutputs(uint32_t outputs) = 0;
+
+  // Temporarily switch bits initialized as outputs to inputs, e.g. to read
+  // back from a bidirectional bus, and back to outputs. Returns 'false' if
+  // switching to inputs failed; the bits are still driven then.
+  virtual bool SwitchToInputs(uint32_t bits) = 0;
+  virtual void SwitchToOutputs(uint32_t bits) = 0;
+
+  // Read the current level of all pins.
+  virtual uint32_t Read() = 0;
 
   // Set the bits that are '1' in the output. Leave the rest untouched.
-  inline void SetBits(uint32_t value) {
-    gpio_port_[0x1C / sizeof(uint32_t)] = value;
-  }
+  virtual void SetBits(uint32_t value) = 0;
 
   // Clear the bits that are '1' in the output. Leave the rest untouched.
-  inline void ClearBits(uint32_t value) {
-    gpio_port_[0x28 / sizeof(uint32_t)] = value;
-  }
+  virtual void ClearBits(uint32_t value) = 0;
 
-  inline void Write(uint32_t value) {
-    // Writing a word is two operations. The IO is actually pretty slow, so
-    // this should probably  be unnoticable.
-    SetBits(value & output_bits_);
-    ClearBits(~value & output_bits_);
-  }
+  // Set all outputs to the corresponding bit in "value".
+  virtual void Write(uint32_t value) = 0;
+
+  // Wait by spinning in a loop, calibrated against the clock.
+  virtual void busy_nano_sleep(long nanos);
 
-  inline void busy_nano_sleep(long nanos) {
-    busy_wait_impl_(nanos);
+  // Measured speed of the busy_nano_sleep() loop.
+  struct BusyWaitCalibration {
+    uint32_t loops_per_usec;   // Loop iterations per microsecond.
+    uint32_t overhead_nanos;   // Time of a call without any iterations.
+  };
+  const BusyWaitCalibration &busy_wait_calibration() const {
+    return calibration_;
   }
 
+  // Measure the loop speed again if the last time was a while ago, as the
+  // CPU clock might have changed since. Call regularly, but not in the
+  // middle of timing sensitive output as this takes a few milliseconds.
+  virtual void RecalibrateIfDue();
+
+ protected:
+  // To be called in Init().
+  void CalibrateBusyWait();
+
  private:
-  uint32_t output_bits_;
-  volatile uint32_t *gpio_port_;
-  void (*busy_wait_impl_)(long);
+  // Waiting too short breaks the display, waiting too long only costs
+  // time: we use the fastest of the last few measurements.
+  static const int kCalibrationHistory = 6;
+
+  BusyWaitCalibration calibration_;
+  uint32_t measured_loops_per_usec_[kCalibrationHistory];
+  int calibration_count_;
+  int64_t last_calibration_nanos_;
 };
 
-#endif  // RPI_GPIO_H
+#endif  // UPNP_DISPLAY_GPIO_H
@@ -0,0 +1,195 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "gpiochip-gpio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+GpiochipGPIO::GpiochipGPIO(const char *device)
+  : device_(device), chip_fd_(-1), lines_fd_(-1), output_bits_(0),
+    inputs_(0), out_(0), set_failed_(false), line_count_(0) {
+}
+
+GpiochipGPIO::~GpiochipGPIO() {
+  if (lines_fd_ >= 0) close(lines_fd_);  // Releases the lines.
+  if (chip_fd_ >= 0) close(chip_fd_);
+}
+
+int GpiochipGPIO::Ioctl(int fd, unsigned long request, void *arg) {
+  return ioctl(fd, request, arg);
+}
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+
+bool GpiochipGPIO::Init() {
+  chip_fd_ = open(device_, O_RDWR | O_CLOEXEC);
+  if (chip_fd_ < 0) {
+    fprintf(stderr, "%s: %s\n", device_, strerror(errno));
+    return false;
+  }
+  CalibrateBusyWait();
+  return true;
+}
+
+uint32_t GpiochipGPIO::InitOutputs(uint32_t outputs) {
+  if (chip_fd_ < 0) {
+    fprintf(stderr, "Attempt to init outputs but not initialized.\n");
+    return 0;
+  }
+  struct gpio_v2_line_request request;
+  memset(&request, 0, sizeof(request));
+  line_count_ = 0;
+  for (int b = 0; b < 32; ++b) {
+    if (outputs & (1u << b)) {
+      request.offsets[line_count_] = b;
+      line_bit_[line_count_] = 1u << b;
+      ++line_count_;
+    }
+  }
+  request.num_lines = line_count_;
+  request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+  strncpy(request.consumer, "upnp-display", sizeof(request.consumer) - 1);
+  if (Ioctl(chip_fd_, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+    fprintf(stderr, "%s: requesting lines: %s\n", device_, strerror(errno));
+    line_count_ = 0;
+    return 0;
+  }
+  if (lines_fd_ >= 0) close(lines_fd_);
+  lines_fd_ = request.fd;
+  output_bits_ = outputs;
+  inputs_ = 0;
+  out_ = 0;
+  return output_bits_;
+}
+
+uint64_t GpiochipGPIO::ToLines(uint32_t bits) const {
+  uint64_t result = 0;
+  for (int i = 0; i < line_count_; ++i) {
+    if (bits & line_bit_[i]) result |= 1ULL << i;
+  }
+  return result;
+}
+
+uint32_t GpiochipGPIO::FromLines(uint64_t lines) const {
+  uint32_t result = 0;
+  for (int i = 0; i < line_count_; ++i) {
+    if (lines & (1ULL << i)) result |= line_bit_[i];
+  }
+  return result;
+}
+
+bool GpiochipGPIO::Configure() {
+  struct gpio_v2_line_config config;
+  memset(&config, 0, sizeof(config));
+  config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+  // Outputs keep their level.
+  config.attrs[config.num_attrs].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+  config.attrs[config.num_attrs].attr.values = ToLines(out_);
+  config.attrs[config.num_attrs].mask = ToLines(output_bits_ & ~inputs_);
+  ++config.num_attrs;
+  if (inputs_) {
+    config.attrs[config.num_attrs].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+    config.attrs[config.num_attrs].attr.flags = GPIO_V2_LINE_FLAG_INPUT;
+    config.attrs[config.num_attrs].mask = ToLines(inputs_);
+    ++config.num_attrs;
+  }
+  if (Ioctl(lines_fd_, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0) {
+    fprintf(stderr, "%s: configuring lines: %s\n", device_, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool GpiochipGPIO::SwitchToInputs(uint32_t bits) {
+  const uint32_t before = inputs_;
+  inputs_ |= bits & output_bits_;
+  if (inputs_ == before || Configure())
+    return true;
+  inputs_ = before;
+  return false;
+}
+
+void GpiochipGPIO::SwitchToOutputs(uint32_t bits) {
+  const uint32_t before = inputs_;
+  inputs_ &= ~bits;
+  if (inputs_ != before && !Configure())
+    inputs_ = before;  // Still inputs, so don't attempt to set them.
+}
+
+uint32_t GpiochipGPIO::Read() {
+  struct gpio_v2_line_values values;
+  values.bits = 0;
+  values.mask = ToLines(output_bits_);
+  if (Ioctl(lines_fd_, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+    return 0;
+  }
+  return FromLines(values.bits);
+}
+
+void GpiochipGPIO::SetValues(uint32_t bits, uint32_t value) {
+  bits &= output_bits_ & ~inputs_;  // Setting inputs fails.
+  // The LCD often sets lines that already have the level, e.g. the data
+  // lines for repeated nibbles or RS before reading. Save the system call.
+  if ((out_ & bits) == (value & bits)) return;
+  out_ = (out_ & ~bits) | (value & bits);
+  struct gpio_v2_line_values values;
+  values.bits = ToLines(value);
+  values.mask = ToLines(bits);
+  if (Ioctl(lines_fd_, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0
+      && !set_failed_) {
+    // Only once, this would be for every nibble.
+    fprintf(stderr, "%s: setting lines: %s\n", device_, strerror(errno));
+    set_failed_ = true;
+  }
+}
+
+void GpiochipGPIO::SetBits(uint32_t value) {
+  SetValues(value, value);
+}
+
+void GpiochipGPIO::ClearBits(uint32_t value) {
+  SetValues(value, 0);
+}
+
+void GpiochipGPIO::Write(uint32_t value) {
+  SetValues(output_bits_, value);
+}
+
+#else  // Kernel headers without the version 2 interface, before 5.10.
+
+bool GpiochipGPIO::Init() {
+  fprintf(stderr, "%s: built without GPIO character device support "
+          "(needs Linux 5.10 headers); use -g rpi.\n", device_);
+  return false;
+}
+
+uint32_t GpiochipGPIO::InitOutputs(uint32_t) { return 0; }
+bool GpiochipGPIO::SwitchToInputs(uint32_t) { return false; }
+void GpiochipGPIO::SwitchToOutputs(uint32_t) {}
+uint32_t GpiochipGPIO::Read() { return 0; }
+void GpiochipGPIO::SetBits(uint32_t) {}
+void GpiochipGPIO::ClearBits(uint32_t) {}
+void GpiochipGPIO::Write(uint32_t) {}
+
+#endif  // GPIO_V2_GET_LINE_IOCTL
@@ -0,0 +1,74 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_GPIOCHIP_GPIO_
+#define UPNP_DISPLAY_GPIOCHIP_GPIO_
+
+#include <stdint.h>
+
+#include "gpio.h"
+
+// GPIO through the Linux GPIO character device (/dev/gpiochipN), which
+// works on any board with a kernel driver for its GPIO and without access
+// to /dev/mem. Bit N is line N of the chip; on a Raspberry Pi this is the
+// same numbering as RPiGPIO. Each Write(), SetBits() or ClearBits() sets
+// all affected lines with one system call, unless none of them changes
+// its level. Needs the version 2 interface
+// of Linux 5.10 or later; built with older kernel headers, Init() fails.
+class GpiochipGPIO : public GPIO {
+public:
+  explicit GpiochipGPIO(const char *device);
+  virtual ~GpiochipGPIO();
+
+  virtual bool Init();
+  virtual uint32_t InitOutputs(uint32_t outputs);
+  virtual bool SwitchToInputs(uint32_t bits);
+  virtual void SwitchToOutputs(uint32_t bits);
+  virtual uint32_t Read();
+  virtual void SetBits(uint32_t value);
+  virtual void ClearBits(uint32_t value);
+  virtual void Write(uint32_t value);
+
+protected:
+  // All ioctl() calls on the chip and its lines go through here, so that
+  // tests can play the kernel.
+  virtual int Ioctl(int fd, unsigned long request, void *arg);
+
+private:
+  // Convert between our bits and bits of the requested lines.
+  uint64_t ToLines(uint32_t bits) const;
+  uint32_t FromLines(uint64_t lines) const;
+
+  // Set the lines of "bits" to the level in "value".
+  void SetValues(uint32_t bits, uint32_t value);
+
+  // Configure lines as outputs, except for "inputs_". Returns 'false' if
+  // that failed; the configuration is unchanged then.
+  bool Configure();
+
+  const char *const device_;
+  int chip_fd_;
+  int lines_fd_;               // Our request of lines.
+  uint32_t output_bits_;       // Bits requested as outputs.
+  uint32_t inputs_;            // Temporarily switched to input.
+  uint32_t out_;               // Levels of outputs.
+  bool set_failed_;            // Reported a failure to set values.
+  int line_count_;
+  uint32_t line_bit_[32];      // Bit of each requested line.
+};
+
+#endif  // UPNP_DISPLAY_GPIOCHIP_GPIO_
@@ -0,0 +1,310 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "hd44780-model.h"
+
+#include <string.h>
+
+// Timing from the HD44780U datasheet for 2.7 to 4.5V, which is the slower
+// of the two; 5V displays are faster.
+static const int64_t kCycleNanos = 1000;         // t_cycE
+static const int64_t kPulseWidthNanos = 450;     // PW_EH
+static const int64_t kAddressSetupNanos = 60;    // t_AS
+static const int64_t kAddressHoldNanos = 20;     // t_AH
+static const int64_t kDataSetupNanos = 195;      // t_DSW
+static const int64_t kDataHoldNanos = 10;        // t_H
+static const int64_t kDataDelayNanos = 360;      // t_DDR
+
+// Execution times with the typical 270kHz oscillator.
+static const int64_t kOperationNanos = 37000;
+static const int64_t kClearNanos = 1520000;
+static const int64_t kPowerOnFunctionSetNanos = 4100000;
+
+// Writes after this long without any belong to the next update.
+static const int64_t kUpdatePauseNanos = 1000000;
+
+// Only log the first violations of each kind.
+static const int kMaxLoggedViolations = 10;
+
+static const int64_t kLongAgo = -1000000000;
+
+static const char *const kViolationNames[HD44780Model::NUM_VIOLATIONS] = {
+  "enable cycle time",
+  "enable pulse width",
+  "address setup time",
+  "address hold time",
+  "data setup time",
+  "data hold time",
+  "read before data is valid",
+  "write while busy",
+  "bus contention",
+};
+
+HD44780Model::HD44780Model(const char *name, const Wiring &wiring, FILE *log)
+  : name_(name), wiring_(wiring), log_(log), data_mask_(0),
+    levels_(0), driven_(0), enabled_(false),
+    latched_rs_(false), latched_rw_(false), last_rise_(kLongAgo),
+    last_fall_(kLongAgo), last_address_change_(kLongAgo),
+    last_data_change_(kLongAgo),
+    four_bit_mode_(false), low_nibble_next_(false), high_nibble_(0),
+    status_(0), two_lines_(false), increment_(true), display_on_(false),
+    cgram_selected_(false), address_(0), instructions_(0),
+    busy_from_(kLongAgo), busy_until_(kLongAgo),
+    commands_(0), data_written_(0), status_reads_(0), updates_(0),
+    last_write_(kLongAgo) {
+  for (int i = 0; i < 4; ++i) data_mask_ |= wiring_.data[i];
+  memset(ddram_, ' ', sizeof(ddram_));
+  memset(cgram_, 0, sizeof(cgram_));
+  memset(violations_, 0, sizeof(violations_));
+}
+
+HD44780Model::~HD44780Model() {
+  if (log_ == NULL || updates_ == 0) return;
+  fprintf(log_, "%s: %ld bytes written (%ld commands, %ld data) in %ld "
+          "updates, %.1f per update; %ld status reads; %d timing "
+          "violations.\n", name_, bytes_written(), commands_, data_written_,
+          updates_, (double)bytes_written() / updates_, status_reads_,
+          total_violations());
+  for (int v = 0; v < NUM_VIOLATIONS; ++v) {
+    if (violations_[v] > 0) {
+      fprintf(log_, "%s:   %s: %d\n", name_, kViolationNames[v],
+              violations_[v]);
+    }
+  }
+}
+
+int HD44780Model::total_violations() const {
+  int total = 0;
+  for (int v = 0; v < NUM_VIOLATIONS; ++v) total += violations_[v];
+  return total;
+}
+
+void HD44780Model::Report(Violation v, int64_t nanos,
+                          int64_t actual, int64_t limit) {
+  ++violations_[v];
+  if (log_ == NULL || violations_[v] > kMaxLoggedViolations) return;
+  fprintf(log_, "%s: %s at %.6fs", name_, kViolationNames[v], nanos * 1e-9);
+  if (limit > 0) {
+    fprintf(log_, ": %lldns instead of %lldns", (long long)actual,
+            (long long)limit);
+  }
+  fprintf(log_, "%s\n", (violations_[v] == kMaxLoggedViolations
+                         ? " (not logging more of these)" : ""));
+}
+
+uint8_t HD44780Model::DataNibble(uint32_t levels) const {
+  uint8_t result = 0;
+  for (int i = 0; i < 4; ++i) {
+    if (levels & wiring_.data[i]) result |= 1 << i;
+  }
+  return result;
+}
+
+void HD44780Model::Update(int64_t nanos, uint32_t levels, uint32_t driven) {
+  const uint32_t changed = levels ^ levels_;
+  if (changed & (wiring_.rs | wiring_.rw)) {
+    if (enabled_) {
+      Report(ADDRESS_HOLD, nanos, 0, 0);
+    } else if (nanos - last_fall_ < kAddressHoldNanos) {
+      Report(ADDRESS_HOLD, nanos, nanos - last_fall_, kAddressHoldNanos);
+    }
+    last_address_change_ = nanos;
+  }
+  if (changed & data_mask_ & driven) {
+    if (!enabled_ && nanos - last_fall_ < kDataHoldNanos) {
+      Report(DATA_HOLD, nanos, nanos - last_fall_, kDataHoldNanos);
+    }
+    last_data_change_ = nanos;
+  }
+  if (enabled_ && latched_rw_ && (driven & data_mask_ & ~driven_)) {
+    Report(BUS_CONTENTION, nanos, 0, 0);
+  }
+  levels_ = levels;
+  driven_ = driven;
+  if (changed & wiring_.enable) {
+    if (levels & wiring_.enable) {
+      EnableRising(nanos);
+    } else {
+      EnableFalling(nanos);
+    }
+  }
+}
+
+void HD44780Model::EnableRising(int64_t nanos) {
+  if (nanos - last_rise_ < kCycleNanos) {
+    Report(CYCLE_TIME, nanos, nanos - last_rise_, kCycleNanos);
+  }
+  if (nanos - last_address_change_ < kAddressSetupNanos) {
+    Report(ADDRESS_SETUP, nanos, nanos - last_address_change_,
+           kAddressSetupNanos);
+  }
+  enabled_ = true;
+  last_rise_ = nanos;
+  latched_rs_ = (levels_ & wiring_.rs) != 0;
+  latched_rw_ = (levels_ & wiring_.rw) != 0;
+  if (!latched_rw_) return;
+
+  if (driven_ & data_mask_) {
+    Report(BUS_CONTENTION, nanos, 0, 0);
+  }
+  if (!low_nibble_next_) {
+    // Both nibbles of a read come from the state at the first.
+    if (latched_rs_) {
+      status_ = cgram_selected_ ? cgram_[address_ & 0x3f] : ddram_[address_];
+    } else {
+      status_ = (nanos < busy_until_ ? 0x80 : 0) | address_;
+    }
+  }
+}
+
+void HD44780Model::EnableFalling(int64_t nanos) {
+  enabled_ = false;
+  last_fall_ = nanos;
+  if (nanos - last_rise_ < kPulseWidthNanos) {
+    Report(PULSE_WIDTH, nanos, nanos - last_rise_, kPulseWidthNanos);
+  }
+
+  if (latched_rw_) {
+    if (four_bit_mode_) {
+      low_nibble_next_ = !low_nibble_next_;
+      if (low_nibble_next_) return;
+    }
+    if (latched_rs_) {
+      AdvanceAddress();
+    } else {
+      ++status_reads_;
+    }
+    return;
+  }
+
+  if (nanos - last_data_change_ < kDataSetupNanos) {
+    Report(DATA_SETUP, nanos, nanos - last_data_change_, kDataSetupNanos);
+  }
+  if (!low_nibble_next_ && nanos < busy_until_) {
+    Report(WRITE_WHILE_BUSY, nanos, nanos - busy_from_,
+           busy_until_ - busy_from_);
+  }
+  const uint8_t nibble = DataNibble(levels_);
+  if (!four_bit_mode_) {
+    // Only DB4..DB7 are connected, the others read as 0.
+    Execute(nanos, latched_rs_, nibble << 4);
+  } else if (!low_nibble_next_) {
+    high_nibble_ = nibble;
+    low_nibble_next_ = true;
+  } else {
+    low_nibble_next_ = false;
+    Execute(nanos, latched_rs_, (high_nibble_ << 4) | nibble);
+  }
+}
+
+uint32_t HD44780Model::DataOutput(int64_t nanos, bool sampled) {
+  if (!enabled_ || !latched_rw_) return 0;
+  if (nanos - last_rise_ < kDataDelayNanos) {
+    if (sampled) {
+      Report(READ_TOO_EARLY, nanos, nanos - last_rise_, kDataDelayNanos);
+    }
+    return 0;
+  }
+  const uint8_t nibble = (four_bit_mode_ && low_nibble_next_
+                          ? status_ & 0xf : status_ >> 4);
+  uint32_t result = 0;
+  for (int i = 0; i < 4; ++i) {
+    if (nibble & (1 << i)) result |= wiring_.data[i];
+  }
+  return result;
+}
+
+void HD44780Model::AdvanceAddress() {
+  if (cgram_selected_) {
+    address_ = (address_ + (increment_ ? 1 : -1)) & 0x3f;
+    return;
+  }
+  // Addresses of a line are 0x00-0x27 and 0x40-0x67 with two lines,
+  // 0x00-0x4f with one.
+  const int last = two_lines_ ? 0x67 : 0x4f;
+  if (increment_) {
+    if (address_ == last) {
+      address_ = 0;
+    } else if (two_lines_ && address_ == 0x27) {
+      address_ = 0x40;
+    } else {
+      ++address_;
+    }
+  } else {
+    if (address_ == 0) {
+      address_ = last;
+    } else if (two_lines_ && address_ == 0x40) {
+      address_ = 0x27;
+    } else {
+      --address_;
+    }
+  }
+}
+
+void HD44780Model::Execute(int64_t nanos, bool is_data, uint8_t value) {
+  if (nanos - last_write_ > kUpdatePauseNanos) ++updates_;
+  last_write_ = nanos;
+
+  int64_t duration = kOperationNanos;
+  if (is_data) {
+    ++data_written_;
+    if (cgram_selected_) {
+      cgram_[address_ & 0x3f] = value;
+    } else {
+      ddram_[address_] = value;
+    }
+    AdvanceAddress();
+  } else {
+    ++commands_;
+    if (value & 0x80) {         // Set DDRAM address.
+      cgram_selected_ = false;
+      address_ = value & 0x7f;
+    } else if (value & 0x40) {  // Set CGRAM address.
+      cgram_selected_ = true;
+      address_ = value & 0x3f;
+    } else if (value & 0x20) {  // Function set.
+      four_bit_mode_ = (value & 0x10) == 0;
+      two_lines_ = (value & 0x08) != 0;
+      if (instructions_ == 0) duration = kPowerOnFunctionSetNanos;
+    } else if (value & 0x10) {  // Cursor or display shift.
+      if ((value & 0x08) == 0) {
+        const bool saved_increment = increment_;
+        increment_ = (value & 0x04) != 0;
+        AdvanceAddress();
+        increment_ = saved_increment;
+      }
+    } else if (value & 0x08) {  // Display control.
+      display_on_ = (value & 0x04) != 0;
+    } else if (value & 0x04) {  // Entry mode.
+      increment_ = (value & 0x02) != 0;
+    } else if (value & 0x02) {  // Return home.
+      cgram_selected_ = false;
+      address_ = 0;
+      duration = kClearNanos;
+    } else if (value & 0x01) {  // Clear display.
+      memset(ddram_, ' ', sizeof(ddram_));
+      cgram_selected_ = false;
+      address_ = 0;
+      increment_ = true;
+      duration = kClearNanos;
+    }
+    ++instructions_;
+  }
+  busy_from_ = nanos;
+  busy_until_ = nanos + duration;
+}
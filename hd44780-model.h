@@ -0,0 +1,127 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_HD44780_MODEL_
+#define UPNP_DISPLAY_HD44780_MODEL_
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Behaviour of a HD44780 display controller connected in 4 bit mode, as
+// seen on its pins: decodes what is written into its DDRAM and CGRAM
+// (and answers status reads), and reports when the datasheet timing is
+// not met. Driven by SimGPIO.
+class HD44780Model {
+public:
+  // GPIO bits the controller is connected to.
+  struct Wiring {
+    uint32_t enable;
+    uint32_t rs;
+    uint32_t rw;       // 0 if not connected.
+    uint32_t data[4];  // DB4..DB7.
+  };
+
+  enum Violation {
+    CYCLE_TIME,        // Enable pulses too close.
+    PULSE_WIDTH,       // Enable pulse too short.
+    ADDRESS_SETUP,     // RS or R/W changed shortly before enable.
+    ADDRESS_HOLD,      // RS or R/W changed while or shortly after enabled.
+    DATA_SETUP,        // Data changed shortly before end of enable pulse.
+    DATA_HOLD,         // Data changed shortly after end of enable pulse.
+    READ_TOO_EARLY,    // Read before the display drives the data.
+    WRITE_WHILE_BUSY,  // Written before the last operation finished.
+    BUS_CONTENTION,    // Display and GPIO both drive the data lines.
+    NUM_VIOLATIONS
+  };
+
+  // Log violations and statistics with "name" to "log" (can be NULL).
+  HD44780Model(const char *name, const Wiring &wiring, FILE *log);
+  ~HD44780Model();  // Logs statistics.
+
+  // The levels of the pins changed at "nanos"; data lines are only
+  // considered where "driven" by the GPIO.
+  void Update(int64_t nanos, uint32_t levels, uint32_t driven);
+
+  // The data lines the display drives at "nanos" (while being read),
+  // others are 0. "sampled": GPIO reads now, so the data must be valid.
+  uint32_t DataOutput(int64_t nanos, bool sampled);
+
+  // Current content.
+  const uint8_t *ddram() const { return ddram_; }   // 128 bytes.
+  const uint8_t *cgram() const { return cgram_; }   // 64 bytes.
+  int address_counter() const { return address_; }
+  bool display_on() const { return display_on_; }
+
+  // Statistics.
+  int violations(Violation v) const { return violations_[v]; }
+  int total_violations() const;
+  long bytes_written() const { return commands_ + data_written_; }
+  long commands() const { return commands_; }
+  long data_written() const { return data_written_; }
+  long status_reads() const { return status_reads_; }
+  // Writes separated by a pause, e.g. one per frame.
+  long updates() const { return updates_; }
+
+private:
+  void Report(Violation v, int64_t nanos, int64_t actual, int64_t limit);
+  void EnableRising(int64_t nanos);
+  void EnableFalling(int64_t nanos);
+  void Execute(int64_t nanos, bool is_data, uint8_t value);
+  void AdvanceAddress();
+  uint8_t DataNibble(uint32_t levels) const;
+
+  const char *const name_;
+  const Wiring wiring_;
+  FILE *const log_;
+  uint32_t data_mask_;
+
+  // Pin state.
+  uint32_t levels_;
+  uint32_t driven_;
+  bool enabled_;
+  bool latched_rs_;      // RS and R/W when enable went high.
+  bool latched_rw_;
+  int64_t last_rise_;
+  int64_t last_fall_;
+  int64_t last_address_change_;
+  int64_t last_data_change_;
+
+  // Controller state.
+  bool four_bit_mode_;
+  bool low_nibble_next_;
+  uint8_t high_nibble_;
+  uint8_t status_;       // Latched for reading both nibbles.
+  bool two_lines_;
+  bool increment_;
+  bool display_on_;
+  bool cgram_selected_;
+  uint8_t address_;
+  int instructions_;
+  int64_t busy_from_;    // Time of the current operation.
+  int64_t busy_until_;
+  uint8_t ddram_[128];
+  uint8_t cgram_[64];
+
+  int violations_[NUM_VIOLATIONS];
+  long commands_;
+  long data_written_;
+  long status_reads_;
+  long updates_;
+  int64_t last_write_;
+};
+
+#endif  // UPNP_DISPLAY_HD44780_MODEL_
@@ -0,0 +1,275 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "layout.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "frame.h"
+#include "utf8.h"
+
+static const char *const kFieldNames[NUM_LAYOUT_FIELDS] = {
+  "title", "artist", "album", "composer", "genre", "year",
+  "player", "state", "time", "remaining", "volume", "progress"
+};
+
+// Append progress bar of "width" cells showing "permille".
+static void AppendProgressBar(int permille, int width, std::string *out) {
+  if (permille < 0) permille = 0;
+  if (permille > 1000) permille = 1000;
+  const int steps = Frame::kProgressBarSteps;
+  int pixels = permille * width * steps / 1000;
+  for (int i = 0; i < width; ++i) {
+    const int fill = pixels > steps ? steps : pixels;
+    pixels -= fill;
+    const Frame::Codepoint cp = Frame::kProgressBar + fill;
+    // All in the private use area: three bytes UTF-8.
+    out->push_back(0xE0 | (cp >> 12));
+    out->push_back(0x80 | ((cp >> 6) & 0x3F));
+    out->push_back(0x80 | (cp & 0x3F));
+  }
+}
+
+static bool IsNameChar(char c) {
+  return (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static bool LookupField(const std::string &name, LayoutField *field) {
+  for (int i = 0; i < NUM_LAYOUT_FIELDS; ++i) {
+    if (name == kFieldNames[i]) {
+      *field = static_cast<LayoutField>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+LineLayout::LineLayout() : body_start_(0), body_alignment_(ALIGN_CENTER) {}
+
+void LineLayout::AddLiteral(const std::string &text, int *start, int *len) {
+  *start = literals_.size();
+  *len = text.size();
+  literals_.append(text);
+}
+
+bool LineLayout::Compile(const std::string &layout, std::string *error) {
+  program_.clear();
+  literals_.clear();
+  body_start_ = -1;
+  body_alignment_ = ALIGN_CENTER;
+
+  std::string::size_type pos = 0;
+  while (pos < layout.size()) {
+    const std::string::size_type open = layout.find('{', pos);
+    const std::string literal = layout.substr(pos, open - pos);
+    if (literal.find('}') != std::string::npos) {
+      *error = "Unexpected '}' in layout \"" + layout + "\"";
+      return false;
+    }
+    if (!literal.empty()) {
+      Segment segment;
+      segment.field_count = 0;
+      AddLiteral(literal, &segment.prefix_start, &segment.prefix_len);
+      segment.suffix_start = segment.suffix_len = 0;
+      program_.push_back(segment);
+    }
+    if (open == std::string::npos)
+      break;
+    const std::string::size_type close = layout.find('}', open);
+    if (close == std::string::npos) {
+      *error = "Missing '}' in layout \"" + layout + "\"";
+      return false;
+    }
+    if (!CompileSegment(layout.substr(open + 1, close - open - 1), error))
+      return false;
+    pos = close + 1;
+  }
+
+  if (body_start_ < 0) body_start_ = 0;  // No marker: all is body.
+  return true;
+}
+
+bool LineLayout::CompileSegment(const std::string &spec, std::string *error) {
+  Segment segment;
+  segment.field_count = 0;
+
+  // Everything up to the first word that is a field name is the prefix,
+  // so the prefix can have words too, e.g. "{by artist}".
+  std::string::size_type i = 0;
+  std::string first_word;
+  for (;;) {
+    while (i < spec.size() && !IsNameChar(spec[i])) ++i;
+    std::string::size_type end = i;
+    while (end < spec.size() && IsNameChar(spec[end])) ++end;
+    const std::string word = spec.substr(i, end - i);
+    LayoutField field;
+    if (word.empty() || LookupField(word, &field))
+      break;
+    if (first_word.empty()) first_word = word;
+    i = end;
+  }
+  if (i == spec.size() && !first_word.empty()) {
+    *error = "Unknown field '" + first_word + "' in {" + spec + "}";
+    return false;
+  }
+  AddLiteral(spec.substr(0, i), &segment.prefix_start, &segment.prefix_len);
+
+  char joiner = '|';
+  for (;;) {
+    const std::string::size_type name_start = i;
+    while (i < spec.size() && IsNameChar(spec[i])) ++i;
+    const std::string name = spec.substr(name_start, i - name_start);
+    if (name.empty()) {
+      *error = "Missing field name in {" + spec + "}";
+      return false;
+    }
+    if (segment.field_count == kMaxFieldsPerSegment) {
+      *error = "Too many fields in {" + spec + "}";
+      return false;
+    }
+    if (!LookupField(name, &segment.fields[segment.field_count])) {
+      *error = "Unknown field '" + name + "' in {" + spec + "}";
+      return false;
+    }
+    segment.joiner[segment.field_count] = joiner;
+    segment.field_count++;
+
+    // Another field follows if there is a joiner directly before a name.
+    if (i + 1 < spec.size() && (spec[i] == '|' || spec[i] == '/')
+        && IsNameChar(spec[i+1])) {
+      joiner = spec[i];
+      ++i;
+      continue;
+    }
+    break;
+  }
+
+  // Rest is suffix, possibly followed by an alignment marker.
+  std::string::size_type suffix_end = spec.size();
+  if (suffix_end > i) {
+    const char marker = spec[suffix_end - 1];
+    if (marker == '<' || marker == '^' || marker == '>') {
+      if (body_start_ >= 0) {
+        *error = "Only one alignment marker allowed per line.";
+        return false;
+      }
+      body_start_ = program_.size();
+      body_alignment_ = (marker == '<' ? ALIGN_LEFT
+                         : marker == '^' ? ALIGN_CENTER
+                         : ALIGN_RIGHT);
+      --suffix_end;
+    }
+  }
+  AddLiteral(spec.substr(i, suffix_end - i),
+             &segment.suffix_start, &segment.suffix_len);
+  program_.push_back(segment);
+  return true;
+}
+
+void LineLayout::Render(const std::string *fields, int width,
+                        std::string *head, std::string *body) const {
+  head->clear();
+  body->clear();
+  int available_width = width;
+  std::string *progress_out = NULL;
+  std::string::size_type progress_pos = std::string::npos;
+  for (int i = 0; i < (int)program_.size(); ++i) {
+    if (i == body_start_) {
+      available_width = width - utf8_len(*head);
+    }
+    std::string *out = (i < body_start_) ? head : body;
+    RenderSegment(program_[i], fields, available_width, out, &progress_pos);
+    if (progress_pos != std::string::npos && progress_out == NULL) {
+      progress_out = out;
+    }
+  }
+
+  // The progress bar takes whatever space is left.
+  if (progress_out != NULL) {
+    const int bar_width = width - utf8_len(*head) - utf8_len(*body);
+    if (bar_width > 0) {
+      // Render at end, then move in place. No temporary string needed.
+      const std::string::size_type end = progress_out->size();
+      AppendProgressBar(atoi(fields[FIELD_PROGRESS].c_str()), bar_width,
+                        progress_out);
+      std::rotate(progress_out->begin() + progress_pos,
+                  progress_out->begin() + end, progress_out->end());
+    }
+  }
+}
+
+void LineLayout::RenderSegment(const Segment &segment,
+                               const std::string *fields,
+                               int available_width,
+                               std::string *out,
+                               std::string::size_type *progress_pos) const {
+  if (segment.field_count == 0) {
+    out->append(literals_, segment.prefix_start, segment.prefix_len);
+    return;
+  }
+
+  // Determine which of the fields contribute to the output.
+  const std::string *chosen[kMaxFieldsPerSegment];
+  int chosen_count = 0;
+  int used_width = -1;   // Only determined when needed.
+  for (int f = 0; f < segment.field_count; ++f) {
+    const std::string &value = fields[segment.fields[f]];
+    if (value.empty())
+      continue;
+    if (chosen_count == 0) {
+      chosen[chosen_count++] = &value;
+      continue;
+    }
+    if (segment.joiner[f] == '|')
+      continue;  // Only a fallback; we already have a value.
+
+    // A '/' addition: only if it adds information and fits.
+    if (value == *chosen[chosen_count - 1])
+      continue;
+    if (used_width < 0) {
+      used_width = utf8_len(*out) + utf8_character_count(
+        literals_.begin() + segment.prefix_start,
+        literals_.begin() + segment.prefix_start + segment.prefix_len);
+      for (int c = 0; c < chosen_count; ++c) {
+        used_width += utf8_len(*chosen[c]);
+      }
+    }
+    const int value_width = utf8_len(value);
+    if (used_width + 1 + value_width <= available_width
+        || used_width > available_width) {
+      chosen[chosen_count++] = &value;
+      used_width += 1 + value_width;
+    }
+  }
+  if (chosen_count == 0)
+    return;
+
+  out->append(literals_, segment.prefix_start, segment.prefix_len);
+  for (int c = 0; c < chosen_count; ++c) {
+    if (c > 0) out->append("/");
+    if (chosen[c] == &fields[FIELD_PROGRESS]) {
+      // Only one bar per line; inserted later when we know its width.
+      if (*progress_pos == std::string::npos) *progress_pos = out->size();
+      continue;
+    }
+    out->append(*chosen[c]);
+  }
+  out->append(literals_, segment.suffix_start, segment.suffix_len);
+}
@@ -0,0 +1,106 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_LAYOUT_
+#define UPNP_DISPLAY_LAYOUT_
+
+#include <string>
+#include <vector>
+
+// Values that can be referenced in a layout template.
+enum LayoutField {
+  FIELD_TITLE,
+  FIELD_ARTIST,
+  FIELD_ALBUM,
+  FIELD_COMPOSER,
+  FIELD_GENRE,
+  FIELD_YEAR,
+  FIELD_PLAYER,    // Friendly name of the renderer.
+  FIELD_STATE,     // Play/pause/stop symbol.
+  FIELD_TIME,      // Playback position, or track duration if unknown.
+  FIELD_REMAINING, // Negative remaining time; empty if unknown.
+  FIELD_VOLUME,
+  FIELD_PROGRESS,  // Track position in permille; rendered as bar.
+
+  NUM_LAYOUT_FIELDS
+};
+
+// Layout of one display line, compiled from a template such as
+//   "{composer: }{title}"  or  "{time} {album/artist>}"
+//
+// Text outside braces is printed literally. Within braces, the first word
+// that is a field name is replaced with its value; any text before or after
+// it (e.g. "{by artist}") is only printed if the value is non-empty.
+// Multiple fields can be combined:
+//   {a|b}   use a, or b if a is empty.
+//   {a/b}   "a/b"; b is only added if different from a and there is
+//           enough space (or if a alone does not fit anyway).
+//
+// The 'progress' field is special: its value is a number 0..1000 and it is
+// shown as a bar (see Frame::kProgressBar) filling all of the line that is
+// not used by other text.
+//
+// A line consists of a fixed head, and a body that is scrolled if it doesn't
+// fit. The body starts with the field that is marked with an alignment
+// character as last character within the braces: '<' left, '^' center,
+// '>' right. Without such a marker, the whole line is a centered body.
+//
+// The template is parsed once into a compact program; rendering it does not
+// re-parse and does not allocate memory once the output strings have grown
+// to their working size.
+class LineLayout {
+public:
+  enum Alignment { ALIGN_LEFT, ALIGN_CENTER, ALIGN_RIGHT };
+
+  LineLayout();
+
+  // Compile template. Returns 'false' and sets "error" on syntax errors.
+  bool Compile(const std::string &layout_template, std::string *error);
+
+  // Render with the given "fields" (indexed by LayoutField) for a display
+  // of given width. Output is split in "head" and "body"; the caller aligns
+  // and scrolls the body in the remaining width.
+  void Render(const std::string *fields, int width,
+              std::string *head, std::string *body) const;
+
+  Alignment body_alignment() const { return body_alignment_; }
+
+private:
+  static const int kMaxFieldsPerSegment = 4;
+
+  // A literal, or a field expression with its conditional prefix/suffix.
+  struct Segment {
+    int field_count;    // 0 for a plain literal (stored as prefix).
+    LayoutField fields[kMaxFieldsPerSegment];
+    char joiner[kMaxFieldsPerSegment];  // '|' or '/' before fields[i], i > 0
+    int prefix_start, prefix_len;       // Offsets into literals_
+    int suffix_start, suffix_len;
+  };
+
+  bool CompileSegment(const std::string &spec, std::string *error);
+  void AddLiteral(const std::string &text, int *start, int *len);
+  void RenderSegment(const Segment &segment, const std::string *fields,
+                     int available_width, std::string *out,
+                     std::string::size_type *progress_pos) const;
+
+  std::vector<Segment> program_;
+  std::string literals_;
+  int body_start_;        // Index of first segment in body.
+  Alignment body_alignment_;
+};
+
+#endif  // UPNP_DISPLAY_LAYOUT_
@@ -20,131 +20,288 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "font.h"
 #include "gpio.h"
-#include "font-data.h"
-#include "utf8.h"
-
-GPIO gpio;
 
 // According to datasheet, basic ops are typically ~37usec
 #define LCD_DISPLAY_OPERATION_WAIT_USEC 50
 
-// Time between sending two nibbles.
-#define LCD_ENABLE_PULSE_TIME_NSEC 400
+// Width of the enable pulse. The datasheet minimum is 450ns; busy waiting
+// is calibrated, so this is what we get plus the time the GPIO writes take.
+#define LCD_ENABLE_PULSE_TIME_NSEC 450
+
+// RS and R/W need to be set this long before the enable pulse.
+#define LCD_ADDRESS_SETUP_TIME_NSEC 60
+
+// Time between enable pulses; with the above, an enable cycle is longer
+// than the minimum of 1000ns.
+#define LCD_ENABLE_LOW_TIME_NSEC 550
 
 // The following GPIO mapping allows to have all wiring in one row to
 // accomodate simpling wiring.
 #define LCD_E (1<<18)
 #define LCD_RS (1<<14)
 
+// Enable line of the second controller on 40x4 displays.
+#define LCD_E2 (1<<7)
+
 #define LCD_D0_BIT (1<<23)
 #define LCD_D1_BIT (1<<24)
 #define LCD_D2_BIT (1<<25)
 #define LCD_D3_BIT (1<<8)
+#define LCD_DATA_BITS (LCD_D0_BIT | LCD_D1_BIT | LCD_D2_BIT | LCD_D3_BIT)
+
+// Optional: read/write line, needed to read the busy flag.
+#define LCD_RW (1<<15)
+
+// Longest operation (clear display) takes 1.52ms; if the busy flag still
+// is set after this time, something is wrong.
+#define LCD_BUSY_TIMEOUT_USEC 10000
 
-static void WriteNibble(bool is_command, uint8_t b) {
+// Clean cells between two dirty runs are re-written if there are at most
+// this many: each costs as much as the set-address command that it saves.
+static const int kMaxMergeGap = 1;
+
+void LCDDisplay::WriteNibble(uint32_t enable, bool is_command, uint8_t b) {
   uint32_t out = is_command ? 0 : LCD_RS;
   out |= (b & 0x1) ? LCD_D0_BIT : 0;
   out |= (b & 0x2) ? LCD_D1_BIT : 0;
   out |= (b & 0x4) ? LCD_D2_BIT : 0;
   out |= (b & 0x8) ? LCD_D3_BIT : 0;
-  out |= LCD_E;
-  gpio.Write(out);
+  gpio_->Write(out);
   // We don't want to do a sleep because we don't want to risk a context
   // switch - Linux might come back way to late (the LCD display times out
   // between two Nibble-writes and ends up in a broken state).
-  gpio.busy_nano_sleep(LCD_ENABLE_PULSE_TIME_NSEC);
-  gpio.ClearBits(LCD_E);
+  gpio_->busy_nano_sleep(LCD_ADDRESS_SETUP_TIME_NSEC);
+  gpio_->SetBits(enable);
+  gpio_->busy_nano_sleep(LCD_ENABLE_PULSE_TIME_NSEC);
+  gpio_->ClearBits(enable);
+  gpio_->busy_nano_sleep(LCD_ENABLE_LOW_TIME_NSEC);
 }
 
-// Write data to display. Differentiates if this is a command byte or data
-// byte.
-static void WriteByte(bool is_command, uint8_t b) {
-  WriteNibble(is_command, (b >> 4) & 0xf);
-  WriteNibble(is_command, b & 0xf);
-  usleep(LCD_DISPLAY_OPERATION_WAIT_USEC);
+bool LCDDisplay::StartReading() {
+  gpio_->ClearBits(LCD_RS);
+  if (!gpio_->SwitchToInputs(LCD_DATA_BITS))
+    return false;  // Still driving the data lines: don't let the display.
+  gpio_->SetBits(LCD_RW);
+  gpio_->busy_nano_sleep(LCD_ADDRESS_SETUP_TIME_NSEC);
+  return true;
 }
 
-static int compare_glyph(const void *key, const void *array_member) {
-  return *((const uint32_t*)key) - ((const Font5x8*)array_member)->codepoint;
+void LCDDisplay::StopReading() {
+  gpio_->ClearBits(LCD_RW);
+  gpio_->SwitchToOutputs(LCD_DATA_BITS);
 }
 
-// Find font for codepoint from our sorted compiled-in table.
-static const Font5x8 *findGlyph(const uint32_t codepoint) {
-  return (const Font5x8*)bsearch(&codepoint, kFontData, kFontDataSize,
-                                 sizeof(Font5x8), compare_glyph);
+uint8_t LCDDisplay::ReadNibble(uint32_t enable) {
+  gpio_->SetBits(enable);
+  gpio_->busy_nano_sleep(LCD_ENABLE_PULSE_TIME_NSEC);  // Data becomes valid.
+  const uint32_t in = gpio_->Read();
+  gpio_->ClearBits(enable);
+  gpio_->busy_nano_sleep(LCD_ENABLE_LOW_TIME_NSEC);
+  return (((in & LCD_D0_BIT) ? 0x1 : 0) | ((in & LCD_D1_BIT) ? 0x2 : 0)
+          | ((in & LCD_D2_BIT) ? 0x4 : 0) | ((in & LCD_D3_BIT) ? 0x8 : 0));
 }
 
-static void LCDStoreGlyph(uint8_t num, const Font5x8 *glyph) {
-  assert(glyph);
-  assert(num < 8);
-  WriteByte(true, 0x40 + (num << 3));
-  for (int i = 0; i < 8; ++i) {
-    WriteByte(false, glyph->bitmap[i] >> 3);  // font is left aligned in data.
+uint8_t LCDDisplay::ReadStatus(uint32_t enable) {
+  const uint8_t high = ReadNibble(enable);
+  return (high << 4) | ReadNibble(enable);
+}
+
+static int64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t MonotonicMicros() {
+  return MonotonicNanos() / 1000;
+}
+
+// Wait until the controllers are ready to receive the next byte. Polls the
+// busy flag if we can, otherwise waits the typical time for an operation.
+void LCDDisplay::WaitReady(uint32_t enable) {
+  if (!busy_flag_wired_) {
+    usleep(LCD_DISPLAY_OPERATION_WAIT_USEC);
+    return;
+  }
+  if (!StartReading()) {
+    fprintf(stderr, "Can't read from LCD; falling back to fixed delays.\n");
+    busy_flag_wired_ = false;
+    usleep(LCD_DISPLAY_OPERATION_WAIT_USEC);
+    return;
+  }
+  const int64_t start = MonotonicMicros();
+  bool timed_out = false;
+  // Controllers can only be read one at a time.
+  const uint32_t controllers[] = { LCD_E, LCD_E2 };
+  for (int i = 0; i < 2 && !timed_out; ++i) {
+    if (!(enable & controllers[i])) continue;
+    while (ReadStatus(controllers[i]) & 0x80) {
+      if (MonotonicMicros() - start > LCD_BUSY_TIMEOUT_USEC) {
+        timed_out = true;
+        break;
+      }
+    }
+  }
+  StopReading();
+  if (timed_out) {
+    fprintf(stderr, "LCD busy flag stuck; falling back to fixed delays.\n");
+    busy_flag_wired_ = false;
   }
 }
 
-uint8_t LCDDisplay::FindCharacterFor(Codepoint cp, bool *register_new) {
-  *register_new = false;
-  if (cp < 0x80) return cp;   // Everything regular ASCII is used as-is.
+// Write data to display. Differentiates if this is a command byte or data
+// byte.
+void LCDDisplay::WriteByte(uint32_t enable, bool is_command, uint8_t b) {
+  WriteNibble(enable, is_command, (b >> 4) & 0xf);
+  WriteNibble(enable, is_command, b & 0xf);
+  WaitReady(enable);
+}
 
-  // Conceptually, we need a map codepoint -> char; but this is a really small
-  // list, so this is faster to iterate than having a bulky map.
+// Check that reading from the display works by setting the address counter
+// and reading it back. If R/W is not actually connected, we read garbage.
+bool LCDDisplay::ProbeBusyFlag(uint32_t enable) {
+  const uint32_t controllers[] = { LCD_E, LCD_E2 };
+  const uint8_t probe_address[] = { 0x05, 0x4a };
+  bool success = true;
+  for (int i = 0; i < 2; ++i) {
+    if (!(enable & controllers[i])) continue;
+    for (int p = 0; p < 2; ++p) {
+      WriteByte(controllers[i], true, 0x80 | probe_address[p]);
+      if (!StartReading())
+        return false;
+      success &= ((ReadStatus(controllers[i]) & 0x7f) == probe_address[p]);
+      StopReading();
+    }
+    WriteByte(controllers[i], true, 0x80);
+  }
+  return success;
+}
+
+void LCDDisplay::StoreBitmap(uint32_t enable, uint8_t num,
+                             const uint8_t rows[8]) {
+  assert(num < 8);
+  WriteByte(enable, true, 0x40 + (num << 3));
   for (int i = 0; i < 8; ++i) {
-    if (special_characters_[i] == cp) return i;
+    WriteByte(enable, false, rows[i]);
   }
+}
 
-  // Ok, not there, just use the next free. We're doing a very simple
-  // round-robin approach here, potentially re-using characters that are
-  // still in use. For now, we just assume that the active number of different
-  // characters is small enough to fit.
-  const Font5x8 *glyph = findGlyph(cp);
-  if (glyph == NULL) return '?';  // unicode without glyph for codepoint.
+// Get the pixel rows of the codepoint, as used in StoreBitmap(). This
+// is our font, which is close to, but not exactly what the display ROM has.
+// Returns 'false' if there is no glyph for the codepoint.
+static bool GetGlyphRows(uint32_t codepoint, uint8_t rows[8]) {
+  if (codepoint >= Frame::kProgressBar
+      && codepoint <= Frame::kProgressBar + Frame::kProgressBarSteps) {
+    // Progress bar cell with the left "fill" columns set.
+    const int fill = codepoint - Frame::kProgressBar;
+    const uint8_t row = (0x1f << (5 - fill)) & 0x1f;
+    for (int i = 0; i < 8; ++i) rows[i] = row;
+    return true;
+  }
+  return FontGetGlyph(codepoint, rows);
+}
+
+// Like above, but shows a '?' for codepoints we don't have.
+static void GetGlyphRowsOrFallback(uint32_t codepoint, uint8_t rows[8]) {
+  if (!GetGlyphRows(codepoint, rows)) GetGlyphRows('?', rows);
+}
+
+// Returns the character of the display ROM to show the codepoint, or -1
+// if it needs a custom character.
+static int RomCharacterFor(CharacterRom rom, uint32_t cp) {
+  // Progress bar: empty cells are blank, full ones a block if the ROM has
+  // it. Partially filled cells need custom characters.
+  if (cp == Frame::kProgressBar) return ' ';
+  if (cp == Frame::kProgressBar + Frame::kProgressBarSteps) cp = 0x2588;
+  return FindRomCharacter(rom, cp);
+}
 
-  const uint8_t new_char = (next_free_special_++ % 8);
-  LCDStoreGlyph(new_char, glyph);
-  *register_new = true;
-  special_characters_[new_char] = cp;
-  return new_char;
+/*static*/ HD44780Model::Wiring LCDDisplay::wiring(int controller) {
+  HD44780Model::Wiring result;
+  result.enable = (controller == 0) ? LCD_E : LCD_E2;
+  result.rs = LCD_RS;
+  result.rw = LCD_RW;
+  result.data[0] = LCD_D0_BIT;
+  result.data[1] = LCD_D1_BIT;
+  result.data[2] = LCD_D2_BIT;
+  result.data[3] = LCD_D3_BIT;
+  return result;
 }
 
-LCDDisplay::LCDDisplay(int width) : width_(width), initialized_(false),
-                                    next_free_special_(0) {
-  memset(special_characters_, 0, sizeof(special_characters_));
+LCDDisplay::LCDDisplay(GPIO *gpio, int width, int height)
+  : gpio_(gpio), width_(width), height_(height), rom_(ROM_ASCII),
+    initialized_(false), busy_flag_wired_(false), frame_count_(0) {
+  assert(height == 2 || height == 4);
+  memset(slot_, 0, sizeof(slot_));    // Nothing matches an empty glyph.
+  memset(slot_last_used_, 0, sizeof(slot_last_used_));
+  memset(panel_, ' ', sizeof(panel_));
+
+  // Lines 2 and 4 start at 0x40; on four line displays, lines 3 and 4
+  // continue where lines 1 and 2 end (e.g. 0x14, 0x54 on 20x4 displays).
+  // A controller handles up to 80 characters. Larger displays have two
+  // controllers, each handling two lines.
+  const bool dual_controller = (width * height > 80);
+  all_enable_ = dual_controller ? (LCD_E | LCD_E2) : LCD_E;
+  for (int row = 0; row < height_; ++row) {
+    const bool second_half = (row >= 2);
+    row_address_[row] = ((row % 2) ? 0x40 : 0x00);
+    if (second_half && !dual_controller) row_address_[row] += width_;
+    row_enable_[row] = (second_half && dual_controller) ? LCD_E2 : LCD_E;
+  }
+}
+
+LCDDisplay::~LCDDisplay() {
+  delete gpio_;
 }
 
-bool LCDDisplay::Init() {
-  if (!gpio.Init())
+bool LCDDisplay::Init(bool read_busy_flag) {
+  if (!gpio_->Init())
     return false;
 
-  gpio.InitOutputs(LCD_E | LCD_RS |
-                   LCD_D0_BIT | LCD_D1_BIT | LCD_D2_BIT | LCD_D3_BIT);
-  gpio.Write(0);
+  gpio_->InitOutputs(all_enable_ | LCD_RS | LCD_DATA_BITS
+                   | (read_busy_flag ? LCD_RW : 0));
+  gpio_->Write(0);
   usleep(100000);
 
   // -- This seems to be a reliable initialization sequence:
+  // (all controllers are initialized at the same time)
 
   // Start with 8 bit mode, then instruct to switch to 4 bit mode.
-  WriteNibble(true, 0x03);
+  WriteNibble(all_enable_, true, 0x03);
   usleep(5000);            // If we were in 4 bit mode, timeout makes this 0x30
-  WriteNibble(true, 0x03);
+  WriteNibble(all_enable_, true, 0x03);
   usleep(5000);
 
   // Transition to 4 bit mode.
-  WriteNibble(true, 0x02); // Interpreted as 0x20: 8-bit cmd to switch to 4-bit.
+  // Interpreted as 0x20: 8-bit cmd to switch to 4-bit.
+  WriteNibble(all_enable_, true, 0x02);
   usleep(LCD_DISPLAY_OPERATION_WAIT_USEC);
 
   // From now on, we can write full bytes that we transfer in nibbles.
-  WriteByte(true, 0x28);  // Function set: 4-bit mode, two lines, 5x8 font
-  WriteByte(true, 0x06);  // Entry mode: increment, no shift
-  WriteByte(true, 0x0c);  // Display control: on, no cursor
-
-  WriteByte(true, 0x01);  // Clear display
-  usleep(2000);           // ... which takes up to 1.6ms
+  // Function set: 4-bit mode, two lines, 5x8 font
+  WriteByte(all_enable_, true, 0x28);
+  WriteByte(all_enable_, true, 0x06);  // Entry mode: increment, no shift
+  WriteByte(all_enable_, true, 0x0c);  // Display control: on, no cursor
+
+  WriteByte(all_enable_, true, 0x01);  // Clear display
+  usleep(2000);                        // ... which takes up to 1.6ms
+  memset(panel_, ' ', sizeof(panel_));
+
+  if (read_busy_flag) {
+    busy_flag_wired_ = ProbeBusyFlag(all_enable_);
+    if (!busy_flag_wired_) {
+      fprintf(stderr, "Can't read from LCD; is R/W connected to GPIO 15? "
+              "Using fixed delays.\n");
+    }
+  }
 
   initialized_ = true;
   display_is_on_ = true;
@@ -152,43 +309,258 @@ bool LCDDisplay::Init() {
   return true;
 }
 
+double LCDDisplay::MeasureNibbleRate(int count) {
+  // Set the DDRAM address, which changes nothing we show, over and over.
+  // Only the nibbles are timed, not waiting for the display in between.
+  int64_t nanos = 0;
+  for (int i = 0; i < count; i += 2) {
+    const int64_t start = MonotonicNanos();
+    WriteNibble(all_enable_, true, 0x8);
+    WriteNibble(all_enable_, true, 0x0);
+    nanos += MonotonicNanos() - start;
+    WaitReady(all_enable_);
+  }
+  return nanos > 0 ? (count + count % 2) * 1e9 / nanos : 0;
+}
+
+bool LCDDisplay::CanShow(Codepoint cp) const {
+  return (RomCharacterFor(rom_, cp) >= 0
+          || (cp > Frame::kProgressBar
+              && cp < Frame::kProgressBar + Frame::kProgressBarSteps)
+          || FontHasGlyph(cp));
+}
+
 void LCDDisplay::SaveScreen() {
   if (!display_is_on_) return;
-  Print(0, "");
-  Print(1, "");
-  WriteByte(true, 0x08);
+  SubmitFrame(Frame(width_, height_));  // Empty, so that it wakes up clean.
+  WriteByte(all_enable_, true, 0x08);
   display_is_on_ = false;
 }
 
-void LCDDisplay::Print(int row, const std::string &text) {
+bool LCDDisplay::CollectGlyphs(const Frame &frame, bool with_shift,
+                               Glyph *wanted, int *count) {
+  *count = 0;
+
+  // While a progress bar is visible, all its partial fills come first, so
+  // they never lose their slot to text and stay loaded as the bar grows.
+  bool has_bar = false;
+  for (int row = 0; row < height_ && !has_bar; ++row) {
+    for (int col = 0; col < width_; ++col) {
+      const Codepoint cp = frame.at(row, col);
+      if (cp >= Frame::kProgressBar
+          && cp <= Frame::kProgressBar + Frame::kProgressBarSteps) {
+        has_bar = true;
+        break;
+      }
+    }
+  }
+  if (has_bar) {
+    for (int fill = 1; fill < Frame::kProgressBarSteps; ++fill) {
+      wanted[*count].codepoint = Frame::kProgressBar + fill;
+      GetGlyphRows(wanted[*count].codepoint, wanted[*count].rows);
+      ++*count;
+    }
+  }
+
+  // Then whole characters, in reading order. If there are more different
+  // ones than fit into CGRAM, the later ones are shown as '?'. That way,
+  // the same frame always looks the same, no matter what was before.
+  for (int row = 0; row < height_; ++row) {
+    const Frame::PixelShift &shift = frame.pixel_shift(row);
+    const bool shifted = with_shift && shift.pixels > 0;
+    for (int col = 0; col < width_; ++col) {
+      if (shifted && col >= shift.begin && col < shift.end)
+        continue;
+      const Codepoint cp = frame.at(row, col);
+      const int rom_char = RomCharacterFor(rom_, cp);
+      if (rom_char >= 0) {
+        cell_char_[row][col] = rom_char;
+        continue;
+      }
+      int i = 0;
+      while (i < *count && wanted[i].codepoint != cp) ++i;
+      if (i == *count) {
+        if (i == 8 || !GetGlyphRows(cp, wanted[i].rows)) {
+          cell_char_[row][col] = '?';
+          continue;
+        }
+        wanted[(*count)++].codepoint = cp;
+      }
+      cell_char_[row][col] = -1 - i;
+    }
+  }
+  if (!with_shift)
+    return true;
+
+  // Each shifted cell shows the right part of its character and the left
+  // part of the next. Collect the distinct composites.
+  for (int row = 0; row < height_; ++row) {
+    const Frame::PixelShift &shift = frame.pixel_shift(row);
+    if (shift.pixels <= 0)
+      continue;
+    uint8_t left[8], right[8];
+    GetGlyphRowsOrFallback(frame.at(row, shift.begin), right);
+    for (int col = shift.begin; col < shift.end; ++col) {
+      memcpy(left, right, sizeof(left));
+      GetGlyphRowsOrFallback(col + 1 < shift.end ? frame.at(row, col + 1)
+                             : shift.entering, right);
+      uint8_t bitmap[8];
+      uint8_t any_pixel = 0;
+      for (int i = 0; i < 8; ++i) {
+        bitmap[i] = ((left[i] << shift.pixels)
+                     | (right[i] >> (5 - shift.pixels))) & 0x1f;
+        any_pixel |= bitmap[i];
+      }
+      if (!any_pixel) {
+        cell_char_[row][col] = ' ';
+        continue;
+      }
+      int i = 0;
+      while (i < *count && memcmp(wanted[i].rows, bitmap, 8) != 0) ++i;
+      if (i == *count) {
+        if (i == 8)
+          return false;
+        wanted[i].codepoint = 0;
+        memcpy(wanted[i].rows, bitmap, 8);
+        ++*count;
+      }
+      cell_char_[row][col] = -1 - i;
+    }
+  }
+  return true;
+}
+
+void LCDDisplay::PlanCharacters(const Frame &frame, bool *reloaded) {
+  // If the glyphs for pixel shifted cells don't fit, show the frame with
+  // whole characters instead.
+  Glyph wanted[8];
+  int count;
+  if (!CollectGlyphs(frame, true, wanted, &count)) {
+    CollectGlyphs(frame, false, wanted, &count);
+  }
+
+  // Glyphs already loaded stay where they are.
+  memset(reloaded, 0, 8 * sizeof(*reloaded));
+  int slot_for[8];
+  bool visible[8] = { false };
+  for (int i = 0; i < count; ++i) {
+    slot_for[i] = -1;
+    for (int slot = 0; slot < 8; ++slot) {
+      if (!visible[slot] && slot_[slot].codepoint == wanted[i].codepoint
+          && memcmp(slot_[slot].rows, wanted[i].rows, 8) == 0) {
+        slot_for[i] = slot;
+        visible[slot] = true;
+        break;
+      }
+    }
+  }
+
+  // The others replace the glyph that has not been visible for the longest
+  // time. Characters not visible in this frame are rewritten anyway, so
+  // it doesn't matter if we change their glyph.
+  for (int i = 0; i < count; ++i) {
+    if (slot_for[i] >= 0) continue;
+    int victim = -1;
+    for (int slot = 0; slot < 8; ++slot) {
+      if (!visible[slot] && (victim < 0 || slot_last_used_[slot]
+                             < slot_last_used_[victim])) {
+        victim = slot;
+      }
+    }
+    slot_for[i] = victim;
+    visible[victim] = true;
+    slot_[victim] = wanted[i];
+    reloaded[victim] = true;
+    StoreBitmap(all_enable_, victim, wanted[i].rows);  // All controllers.
+  }
+
+  ++frame_count_;
+  for (int slot = 0; slot < 8; ++slot) {
+    if (visible[slot]) slot_last_used_[slot] = frame_count_;
+  }
+  for (int row = 0; row < height_; ++row) {
+    for (int col = 0; col < width_; ++col) {
+      if (cell_char_[row][col] < 0)
+        cell_char_[row][col] = slot_for[-1 - cell_char_[row][col]];
+    }
+  }
+}
+
+void LCDDisplay::WriteDirtyRuns(int row, const uint8_t *want,
+                                const bool *dirty, int first, int last) {
+  const uint32_t enable = row_enable_[row];
+  const uint8_t address = 0x80 + row_address_[row];
+  int col = first;
+  while (col < last) {
+    if (!dirty[col]) {
+      ++col;
+      continue;
+    }
+    int end = col + 1;
+    for (int next = end; next < last; ++next) {
+      if (!dirty[next]) continue;
+      if (next - end > kMaxMergeGap) break;
+      end = next + 1;
+    }
+    WriteByte(enable, true, address + col);  // Set address to write to.
+    for (/**/; col < end; ++col) {
+      if (dirty[col]) panel_[row][col] = want[col];
+      WriteByte(enable, false, panel_[row][col]);
+    }
+  }
+}
+
+void LCDDisplay::ApplySpans(const Frame &frame,
+                            const Frame::Span *spans, int count) {
   assert(initialized_);  // call Init() first.
-  assert(row < 2);       // uh, out of range.
 
-  if (last_line_[row] == text)
-    return;  // nothing to update.
+  // Between frames, timing doesn't matter.
+  gpio_->RecalibrateIfDue();
 
   if (!display_is_on_) {
-    WriteByte(true, 0x0c);
+    WriteByte(all_enable_, true, 0x0c);
     display_is_on_ = true;
   }
 
-  // Set address to write to; line 2 starts at 0x40
-  WriteByte(true, 0x80 + ((row > 0) ? 0x40 : 0));
-
-  std::string::const_iterator it = text.begin();
-  int screen_pos = 0;
-  for (screen_pos = 0; screen_pos < width_ && it != text.end(); ++screen_pos) {
-    const Codepoint codepoint = utf8_next_codepoint(it);
-    bool ddram_dirty = false;
-    uint8_t char_to_print = FindCharacterFor(codepoint, &ddram_dirty);
-    if (ddram_dirty) {
-      WriteByte(true, 0x80 + ((row > 0) ? 0x40 : 0) + screen_pos);
+  // All glyphs are loaded before writing; loading glyphs into CGRAM in
+  // between would move the address counter.
+  bool reloaded[8];
+  PlanCharacters(frame, reloaded);
+
+  // Cells to look at: the changed spans, and the pixel shifted cells, as
+  // their composites depend on their neighbors and on whether they fit at
+  // all. Unchanged cells only need a look if their custom character got a
+  // new glyph, or if they show '?' as their glyph did not fit before.
+  bool check[kMaxHeight][Frame::kMaxWidth];
+  memset(check, 0, sizeof(check));
+  for (int i = 0; i < count; ++i) {
+    memset(&check[spans[i].row][spans[i].begin], true,
+           spans[i].end - spans[i].begin);
+  }
+  for (int row = 0; row < height_; ++row) {
+    const Frame::PixelShift &shift = frame.pixel_shift(row);
+    if (shift.pixels > 0) {
+      memset(&check[row][shift.begin], true, shift.end - shift.begin);
     }
-    WriteByte(false, char_to_print);
   }
-  // Fill rest with spaces.
-  for (int i = screen_pos; i < width_; ++i) {
-    WriteByte(false, ' ');
+
+  // Of these, write what differs from what we wrote before: changed
+  // codepoints don't necessarily change what is on the panel (e.g. an empty
+  // progress bar cell is a space).
+  uint8_t want[Frame::kMaxWidth];
+  bool dirty[Frame::kMaxWidth];
+  for (int row = 0; row < height_; ++row) {
+    int first = width_, last = 0;
+    for (int col = 0; col < width_; ++col) {
+      const uint8_t shown = panel_[row][col];
+      want[col] = cell_char_[row][col];
+      dirty[col] = ((check[row][col] || shown == '?'
+                     || (shown < 8 && reloaded[shown]))
+                    && want[col] != shown);
+      if (!dirty[col]) continue;
+      if (col < first) first = col;
+      last = col + 1;
+    }
+    WriteDirtyRuns(row, want, dirty, first, last);
   }
-  last_line_[row] = text;
-};
+}
@@ -18,39 +18,125 @@
 #ifndef UPNP_DISPLAY_LCD_
 #define UPNP_DISPLAY_LCD_
 
-#include <string>
 #include <stdint.h>
 
+#include "character-rom.h"
+#include "hd44780-model.h"
 #include "printer.h"
 
+class GPIO;
+
 // An implementation of an interface to a standard 16x2 LCD display
-// connected to RPi GPIO pins.
+// connected to GPIO pins. Also supports 2 or 4 line displays of other
+// widths; displays with more than 80 characters (such as 40x4) have two
+// controllers, the second one is driven by a separate enable line.
 class LCDDisplay : public Printer {
 public:
-  LCDDisplay(int width);
+  // Output via "gpio", of which we take ownership.
+  LCDDisplay(GPIO *gpio, int width, int height);
+  virtual ~LCDDisplay();
 
-  // Call this first.
-  bool Init();
+  // How the first controller, or the second of displays with more than
+  // 80 characters, is connected to the GPIO.
+  static HD44780Model::Wiring wiring(int controller);
 
-  virtual int width() const { return width_; }
+  // Characters the display has in ROM; by default, only ASCII is used.
+  void set_character_rom(CharacterRom rom) { rom_ = rom; }
+
+  // Call this first. With "read_busy_flag", the R/W line is expected on
+  // GPIO 15 and we wait for the display to be ready instead of fixed
+  // delays; if reading the display doesn't work, fixed delays are used.
+  bool Init(bool read_busy_flag = false);
 
-  // Print text in given line.
-  virtual void Print(int line, const std::string &text);
+  // Benchmark of the GPIO: send "count" nibbles of commands that don't
+  // change what is shown. Returns nibbles per second, not counting the
+  // time waiting for the display between bytes. After Init().
+  double MeasureNibbleRate(int count);
+
+  virtual int width() const { return width_; }
+  virtual int height() const { return height_; }
+  virtual bool supports_pixel_shift() const { return true; }
+  virtual bool CanShow(Frame::Codepoint cp) const;
 
   virtual void SaveScreen();
 
+protected:
+  virtual void ApplySpans(const Frame &frame,
+                          const Frame::Span *spans, int count);
+
 private:
-  typedef uint32_t Codepoint;
+  typedef Frame::Codepoint Codepoint;
+
+  // A custom character.
+  struct Glyph {
+    Codepoint codepoint;  // 0 for composites of pixel shifted cells.
+    uint8_t rows[8];      // 5 pixels each, leftmost in bit 4.
+  };
+
+  // Bus access. The "enable" bits determine which controllers take part.
+  void WriteNibble(uint32_t enable, bool is_command, uint8_t b);
+  void WriteByte(uint32_t enable, bool is_command, uint8_t b);
+
+  // While reading, the display drives the data lines, so we must not.
+  // Returns 'false' if we can't stop driving them.
+  bool StartReading();
+  void StopReading();
+  uint8_t ReadNibble(uint32_t enable);
+
+  // Read busy flag (bit 7) and address counter of a single controller.
+  // Must be between StartReading() and StopReading().
+  uint8_t ReadStatus(uint32_t enable);
 
-  uint8_t FindCharacterFor(Codepoint cp, bool *register_new);
+  // Wait until the controllers are ready to receive the next byte.
+  void WaitReady(uint32_t enable);
 
+  // Check that reading the address counter back works.
+  bool ProbeBusyFlag(uint32_t enable);
+
+  // Store 8 rows of 5 pixels, leftmost pixel in bit 4, as custom
+  // character "num".
+  void StoreBitmap(uint32_t enable, uint8_t num, const uint8_t rows[8]);
+
+  // Determine the character of each cell of the frame in cell_char_ and
+  // load the custom characters needed into CGRAM. Sets "reloaded" for
+  // each of the 8 slots that got a new glyph.
+  void PlanCharacters(const Frame &frame, bool *reloaded);
+
+  // Collect up to 8 custom characters "frame" needs in "wanted"; cells
+  // using them get -1 - index in cell_char_. Returns 'false' if the
+  // characters for pixel shifted cells don't fit.
+  bool CollectGlyphs(const Frame &frame, bool with_shift,
+                     Glyph *wanted, int *count);
+
+  // Write the cells marked in "dirty" between "first" and "last" of the
+  // row, merging runs when cheaper than setting the address again.
+  void WriteDirtyRuns(int row, const uint8_t *want, const bool *dirty,
+                      int first, int last);
+
+  GPIO *const gpio_;
   const int width_;
+  const int height_;
+  CharacterRom rom_;
   bool initialized_;
   bool display_is_on_;
-  std::string last_line_[2];
 
-  Codepoint special_characters_[8];  // cgram -> codepoint
-  uint8_t next_free_special_;
+  // If the R/W line is connected, we wait for the busy flag to clear
+  // instead of waiting a fixed time after each byte.
+  bool busy_flag_wired_;
+
+  uint8_t row_address_[kMaxHeight];  // DDRAM address of first column.
+  uint32_t row_enable_[kMaxHeight];  // Enable line of controller for row.
+  uint32_t all_enable_;              // Enable lines of all controllers.
+
+  Glyph slot_[8];                    // Glyphs loaded in CGRAM.
+  uint32_t slot_last_used_[8];       // frame_count_ when last visible.
+  uint32_t frame_count_;
+
+  // Character per cell of the current frame.
+  int16_t cell_char_[kMaxHeight][Frame::kMaxWidth];
+
+  // Character code currently in DDRAM for each cell.
+  uint8_t panel_[kMaxHeight][Frame::kMaxWidth];
 };
 
 #endif // UPNP_DISPLAY_LCD_
@@ -0,0 +1,62 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "line-buffer.h"
+
+#include "utf8.h"
+
+void LineBuffer::Append(const char *begin, const char *end) {
+  const char *it = begin;
+  while (it < end && characters_ < kMaxWidth) {
+    utf8_next_codepoint(it);
+    ++characters_;
+  }
+  if (it > end) it = end;  // Broken UTF-8 at end. Don't copy beyond.
+  memcpy(data_ + size_, begin, it - begin);
+  size_ += it - begin;
+  data_[size_] = '\0';
+}
+
+void LineBuffer::AppendRepeated(char c, int count) {
+  if (count > kMaxWidth - characters_) count = kMaxWidth - characters_;
+  if (count <= 0) return;
+  memset(data_ + size_, c, count);
+  size_ += count;
+  characters_ += count;
+  data_[size_] = '\0';
+}
+
+void LineBuffer::Truncate(int width) {
+  if (width >= characters_) return;
+  const char *it = data_;
+  for (int i = 0; i < width; ++i) {
+    utf8_next_codepoint(it);
+  }
+  size_ = it - data_;
+  characters_ = width;
+  data_[size_] = '\0';
+}
+
+void LineBuffer::PadFront(int count) {
+  if (count > kMaxWidth - characters_) count = kMaxWidth - characters_;
+  if (count <= 0) return;
+  memmove(data_ + count, data_, size_ + 1);  // including '\0'
+  memset(data_, ' ', count);
+  size_ += count;
+  characters_ += count;
+}
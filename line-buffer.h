@@ -0,0 +1,80 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_LINE_BUFFER_
+#define UPNP_DISPLAY_LINE_BUFFER_
+
+#include <string.h>
+#include <string>
+
+// A fixed-capacity buffer holding the UTF-8 text of one display line.
+// It never allocates, so it can be used freely in the display update loop.
+// Text beyond kMaxWidth characters is silently cut off.
+class LineBuffer {
+public:
+  // Widest display line we can handle.
+  static const int kMaxWidth = 64;
+
+  LineBuffer() { Clear(); }
+  explicit LineBuffer(const char *text) { Clear(); Append(text); }
+  explicit LineBuffer(const std::string &text) { Clear(); Append(text); }
+
+  void Clear() { size_ = 0; characters_ = 0; data_[0] = '\0'; }
+
+  // Append UTF-8 text in the range [begin, end).
+  void Append(const char *begin, const char *end);
+  void Append(const char *text) { Append(text, text + strlen(text)); }
+  void Append(const std::string &text) {
+    Append(text.data(), text.data() + text.size());
+  }
+  void Append(const LineBuffer &other) {
+    Append(other.data(), other.data() + other.size());
+  }
+
+  // Append "count" copies of the ASCII character "c".
+  void AppendRepeated(char c, int count);
+
+  // Only keep the first "width" characters.
+  void Truncate(int width);
+
+  // Pad in front to align within a display of given width. Does nothing
+  // if the text already fills the width.
+  void CenterAlign(int width) { PadFront((width - characters_) / 2); }
+  void RightAlign(int width) { PadFront(width - characters_); }
+
+  // NUL-terminated UTF-8 text.
+  const char *data() const { return data_; }
+  int size() const { return size_; }          // Bytes.
+  int characters() const { return characters_; }
+  bool empty() const { return size_ == 0; }
+
+  bool operator==(const LineBuffer &other) const {
+    return size_ == other.size_ && memcmp(data_, other.data_, size_) == 0;
+  }
+  bool operator!=(const LineBuffer &other) const { return !(*this == other); }
+
+private:
+  void PadFront(int count);
+
+  // Worst case UTF-8 sequences as handled by utf8_next_codepoint() are
+  // six bytes long.
+  char data_[6 * kMaxWidth + 1];
+  int size_;
+  int characters_;
+};
+
+#endif  // UPNP_DISPLAY_LINE_BUFFER_
@@ -17,32 +17,145 @@
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <limits.h>
-#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <vector>
+
+#include "character-rom.h"
+#include "clock.h"
 #include "controller-state.h"
+#include "font.h"
+#include "gpiochip-gpio.h"
+#include "hd44780-model.h"
 #include "upnp-display.h"
 #include "lcd-display.h"
 #include "printer.h"
+#include "rpi-gpio.h"
+#include "sim-gpio.h"
+#include "threaded-printer.h"
 
 // Width of your display. Usually this is just 16 wide, but you can get 24 or
 // even 40 wide displays. You can also set this via the -w option.
 #define DEFAULT_LCD_DISPLAY_WIDTH 16
+#define DEFAULT_LCD_DISPLAY_HEIGHT 2
+
+// Layout of the last line with -P.
+static const char kProgressLayout[] = "{time} {progress}";
+
+// A display as requested with -o <type>[:<renderer>]
+struct OutputSpec {
+  std::string type;
+  std::string match_name;
+};
+
+static bool ParseOutputSpec(const char *spec, const std::string &default_match,
+                            OutputSpec *out) {
+  const char *colon = strchr(spec, ':');
+  out->type.assign(spec, colon ? colon - spec : strlen(spec));
+  out->match_name = colon ? colon + 1 : default_match;
+  return (out->type == "lcd" || out->type == "console"
+          || out->type == "console-inplace");
+}
+
+// The LCD supports these heights; the console any.
+static bool IsLCDHeight(int height) {
+  return height == 2 || height == 4;
+}
+
+// GPIO as requested with -g rpi, -g gpiochip[:<device>] or
+// -g sim[:<waveform-file>]. Returns NULL
+// with a message on failure.
+static GPIO *CreateGPIO(const char *spec, FILE *logstream) {
+  if (strcmp(spec, "rpi") == 0) {
+    return new RPiGPIO();
+  }
+  if (strncmp(spec, "gpiochip", 8) == 0) {
+    if (spec[8] == '\0') return new GpiochipGPIO("/dev/gpiochip0");
+    if (spec[8] == ':') return new GpiochipGPIO(spec + 9);
+  }
+  if (strncmp(spec, "sim", 3) != 0 || (spec[3] != '\0' && spec[3] != ':')) {
+    fprintf(stderr, "Unknown GPIO %s\n", spec);
+    return NULL;
+  }
+  FILE *waveform = NULL;
+  if (spec[3] == ':' && (waveform = fopen(spec + 4, "w")) == NULL) {
+    perror(spec + 4);
+    return NULL;
+  }
+  SimGPIO *sim = new SimGPIO(waveform);
+  // Both controllers; the second only sees anything on large displays.
+  sim->AddController(new HD44780Model("lcd", LCDDisplay::wiring(0),
+                                      logstream));
+  sim->AddController(new HD44780Model("lcd-e2", LCDDisplay::wiring(1),
+                                      logstream));
+  return sim;
+}
+
+static Printer *CreatePrinter(const std::string &type, int width, int height,
+                              bool read_busy_flag, CharacterRom rom,
+                              const char *gpio_spec, FILE *logstream) {
+  if (type == "console" || type == "console-inplace") {
+    return new ConsolePrinter(type == "console-inplace", width, height);
+  }
+
+  GPIO *gpio = CreateGPIO(gpio_spec, logstream);
+  if (gpio == NULL) return NULL;
+  LCDDisplay *display = new LCDDisplay(gpio, width, height);
+  display->set_character_rom(rom);
+  if (!display->Init(read_busy_flag)) {
+    fprintf(stderr, "You need to run this as root to have access "
+            "to GPIO pins. Run with sudo (or with option -c/-C to output on "
+            "console instead).\n");
+    delete display;
+    return NULL;
+  }
+
+  // Writing to the LCD is slow and timing sensitive; it gets its own
+  // realtime thread, so the rest of us can run at normal priority.
+  return new ThreadedPrinter(display);
+}
+
+// With -b: how fast we get nibbles to the LCD with this GPIO. Returns the
+// exit code.
+static int BenchmarkGPIO(const char *gpio_spec, int width, int height,
+                         bool read_busy_flag, int nibbles, FILE *logstream) {
+  GPIO *gpio = CreateGPIO(gpio_spec, logstream);
+  if (gpio == NULL) return 1;
+  LCDDisplay display(gpio, width, height);
+  if (!display.Init(read_busy_flag)) {
+    fprintf(stderr, "Can't access GPIO %s\n", gpio_spec);
+    return 1;
+  }
+  const double rate = display.MeasureNibbleRate(nibbles);
+  printf("%s: %d nibbles, %.0f nibbles/s (%.2f usec per nibble)\n",
+         gpio_spec, nibbles, rate, rate > 0 ? 1e6 / rate : 0);
+  return 0;
+}
 
 int main(int argc, char *argv[]) {
   std::string match_name;
   int display_width = DEFAULT_LCD_DISPLAY_WIDTH;
+  int display_height = DEFAULT_LCD_DISPLAY_HEIGHT;
   FILE* logstream = stderr;
   bool print_in_place = false;
   const char *interface_name = NULL;
   bool as_daemon = false;
   bool on_console = false;
   int screensave_after = -1;
+  bool smooth_scroll = false;
+  bool progress_bar = false;
+  bool read_busy_flag = false;
+  CharacterRom character_rom = ROM_ASCII;
+  const char *font_file = NULL;
+  const char *gpio_spec = "rpi";
+  int benchmark_nibbles = 0;
+  std::vector<std::string> layouts;
+  std::vector<std::string> output_specs;
   int opt;
-  while ((opt = getopt(argc, argv, "hn:w:dCcs:qi:")) != -1) {
+  while ((opt = getopt(argc, argv, "hn:w:dCcs:qi:l:o:SPBR:F:g:b:")) != -1) {
     switch (opt) {
     case 'n':
       if (optarg != NULL) match_name = optarg;
@@ -62,12 +175,20 @@ int main(int argc, char *argv[]) {
       break;
 
     case 'w': {
-      int w = atoi(optarg);
-      if (w < 8) {
-        fprintf(stderr, "Invalid width %d\n", w);
+      int w = 0;
+      int h = DEFAULT_LCD_DISPLAY_HEIGHT;
+      if (sscanf(optarg, "%dx%d", &w, &h) < 1
+          || w < 8 || w > LineBuffer::kMaxWidth) {
+        fprintf(stderr, "Invalid width %s\n", optarg);
+        return 1;
+      }
+      if (h < 1 || h > Printer::kMaxHeight) {
+        fprintf(stderr, "Only displays with 1 to %d lines supported.\n",
+                Printer::kMaxHeight);
         return 1;
       }
       display_width = w;
+      display_height = h;
       break;
     }
 
@@ -83,12 +204,55 @@ int main(int argc, char *argv[]) {
       interface_name = strdup(optarg);
       break;
 
+    case 'l':
+      layouts.push_back(optarg);
+      break;
+
+    case 'o':
+      output_specs.push_back(optarg);
+      break;
+
+    case 'S':
+      smooth_scroll = true;
+      break;
+
+    case 'P':
+      progress_bar = true;
+      break;
+
+    case 'B':
+      read_busy_flag = true;
+      break;
+
+    case 'R':
+      if (!ParseCharacterRom(optarg, &character_rom)) {
+        fprintf(stderr, "Unknown character ROM %s\n", optarg);
+        return 1;
+      }
+      break;
+
+    case 'F':
+      font_file = optarg;
+      break;
+
+    case 'g':
+      gpio_spec = optarg;
+      break;
+
+    case 'b':
+      benchmark_nibbles = atoi(optarg);
+      if (benchmark_nibbles <= 0) {
+        fprintf(stderr, "-b needs a number of nibbles\n");
+        return 1;
+      }
+      break;
+
     case 'h':
     default:
       fprintf(stderr, "Usage: %s <options>\n", argv[0]);
       fprintf(stderr, "\t-n <name or \"uuid:\"<uuid>"
               ": Connect to this renderer.\n"
-              "\t-w <display-width>       : Set display width.\n"
+              "\t-w <width>[x<height>]    : Set display size, e.g. 20x4.\n"
               "\t-q                       : Quiet. Less log output\n"
               "\t-c                       : Log LCD output on console instead\n"
               "\t                           (does not need Raspberry Pi GPIO)\n"
@@ -96,6 +260,33 @@ int main(int argc, char *argv[]) {
               "\t                           (Best with -q: no logs interfere)\n"
               "\t-s <timeout-seconds>     : Screensave after this time.\n"
               "\t-i <interface>           : use this network interface.\n"
+              "\t-l <layout>              : Layout template for next line.\n"
+              "\t                           Repeat for each line; empty for\n"
+              "\t                           default. E.g. -l '{title}'\n"
+              "\t                           -l '{time} {album|artist>}'\n"
+              "\t-o <type>[:<renderer>]   : Add a display showing renderer\n"
+              "\t                           (default: -n). Types: lcd,\n"
+              "\t                           console, console-inplace.\n"
+              "\t                           Repeat for multiple displays.\n"
+              "\t-S                       : Smooth scrolling on LCD, for\n"
+              "\t                           scrolling text of at most 8\n"
+              "\t                           columns (see README).\n"
+              "\t-P                       : Progress bar in last line.\n"
+              "\t-B                       : LCD R/W wired to GPIO 15: wait\n"
+              "\t                           for busy flag, not fixed delays.\n"
+              "\t-R <rom>                 : Character ROM of LCD: ascii\n"
+              "\t                           (default), a00 (japanese) or\n"
+              "\t                           a02 (european).\n"
+              "\t-F <font-file>           : Font for characters not in ROM,\n"
+              "\t                           instead of the built-in one.\n"
+              "\t-g <gpio>                : LCD connected to rpi (default)\n"
+              "\t                           gpiochip[:<device>]: with the\n"
+              "\t                           kernel driver (/dev/gpiochip0)\n"
+              "\t                           or sim[:<file>]: a simulation,\n"
+              "\t                           optionally recording waveform.\n"
+              "\t-b <nibbles>             : Benchmark: send this many\n"
+              "\t                           nibbles to the LCD on -g, print\n"
+              "\t                           the rate and exit.\n"
               "\t-d                       : Run as daemon.\n"
               );
       return 1;
@@ -103,31 +294,67 @@ int main(int argc, char *argv[]) {
 
   }
 
-  Printer *printer = NULL;
-  if (on_console) {
-    printer = new ConsolePrinter(print_in_place, display_width, 2);
-  } else {
-    LCDDisplay *display = new LCDDisplay(display_width);
-    if (!display->Init()) {
-      fprintf(stderr, "You need to run this as root to have access "
-              "to GPIO pins. Run with sudo (or with option -c/-C to output on "
-              "console instead).\n");
+  if (benchmark_nibbles > 0) {
+    if (!IsLCDHeight(display_height)) {
+      fprintf(stderr, "LCD displays need 2 or 4 lines.\n");
+      return 1;
+    }
+    return BenchmarkGPIO(gpio_spec, display_width, display_height,
+                         read_busy_flag, benchmark_nibbles, logstream);
+  }
+
+  // Without -o, we have one display as chosen by -c/-C.
+  std::vector<OutputSpec> outputs;
+  if (output_specs.empty()) {
+    OutputSpec spec;
+    spec.type = (on_console
+                 ? (print_in_place ? "console-inplace" : "console")
+                 : "lcd");
+    spec.match_name = match_name;
+    outputs.push_back(spec);
+  }
+  int lcd_count = 0;
+  int inplace_count = 0;
+  for (size_t i = 0; i < output_specs.size(); ++i) {
+    OutputSpec spec;
+    if (!ParseOutputSpec(output_specs[i].c_str(), match_name, &spec)) {
+      fprintf(stderr, "Unknown display type in -o %s\n",
+              output_specs[i].c_str());
       return 1;
     }
+    outputs.push_back(spec);
+  }
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    if (outputs[i].type == "lcd") ++lcd_count;
+    if (outputs[i].type == "console-inplace") ++inplace_count;
+  }
+  if (lcd_count > 0 && !IsLCDHeight(display_height)) {
+    fprintf(stderr, "LCD displays need 2 or 4 lines.\n");
+    return 1;
+  }
+  if (lcd_count > 1 || inplace_count > 1) {
+    fprintf(stderr, "Only one lcd and one console-inplace display "
+            "possible.\n");
+    return 1;
+  }
 
-    // The LCDs have timeouts when certain write operations take too long,
-    // so make sure we tell the kernel we're serious about timing.
-    struct sched_param p;
-    p.sched_priority = 99;
-    if (sched_setscheduler(0, SCHED_FIFO, &p) < 0) {
-        fprintf(stderr,
-                "Couldn't set realtime priority which we need to make sure "
-                "hardware timing is correct .\nConsider running as root or "
-                "granting CAP_SYS_NICE capability "
-                "(sudo setcap cap_sys_nice=eip <program>).\n");
+  if (font_file != NULL) {
+    std::string error;
+    if (!FontLoadFile(font_file, &error)) {
+      fprintf(stderr, "Font file %s: %s\n", font_file, error.c_str());
+      return 1;
     }
+  }
 
-    printer = display;
+  std::vector<Printer*> printers;
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    Printer *printer = CreatePrinter(outputs[i].type,
+                                     display_width, display_height,
+                                     read_busy_flag, character_rom,
+                                     gpio_spec, logstream);
+    if (printer == NULL)
+      return 1;
+    printers.push_back(printer);
   }
 
   // TODO: if running as root: drop priviliges now.
@@ -138,11 +365,41 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  UPnPDisplay ui(match_name, printer, screensave_after, logstream);
-  ControllerState controller(interface_name, &ui, printer, logstream);
-  ui.Loop();
+  RealClock clock;
+  std::vector<UPnPDisplay*> displays;
+  for (size_t d = 0; d < outputs.size(); ++d) {
+    UPnPDisplay *ui = new UPnPDisplay(outputs[d].match_name, printers[d],
+                                      &clock, screensave_after, logstream);
+    ui->set_smooth_scroll(smooth_scroll);
+    if (progress_bar) {
+      // Replaces the default layout; an explicit -l still takes precedence.
+      std::string error;
+      ui->SetLayout(display_height - 1, kProgressLayout, &error);
+    }
+    for (size_t i = 0; i < layouts.size(); ++i) {
+      std::string error;
+      if (!layouts[i].empty() && !ui->SetLayout(i, layouts[i], &error)) {
+        fprintf(stderr, "Layout for line %d: %s\n",
+                (int)i + 1, error.c_str());
+        return 1;
+      }
+    }
+    displays.push_back(ui);
+  }
+
+  // All displays share one controller, so each renderer is subscribed
+  // to only once.
+  ControllerState controller(interface_name, printers, &clock, logstream);
+  for (size_t d = 0; d < displays.size(); ++d) {
+    controller.AddObserver(displays[d]);
+  }
+  UPnPDisplay::Loop(displays, &clock);
 
-  delete printer;
+  // The displays stay registered with the controller (and its callback
+  // threads) until we exit; only release the printers.
+  for (size_t d = 0; d < printers.size(); ++d) {
+    delete printers[d];
+  }
 
   return 0;
 }
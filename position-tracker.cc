@@ -0,0 +1,98 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "position-tracker.h"
+
+#include "clock.h"
+
+// Shortly after a change, poll again to catch renderers that report the
+// new state a little late.
+static const int kConfirmPollMillis = 3000;
+
+// While playing steadily, only re-sync now and then to correct for drift.
+static const int kSteadyPollMillis = 30000;
+
+// If stopped or paused, nothing moves; just check once in a while.
+static const int kIdlePollMillis = 120000;
+
+// If the renderer does not implement the call or fails, don't insist.
+static const int kFailedPollMillis = 60000;
+
+// Give up waiting for a response after this time.
+static const int kPollTimeoutMillis = 10000;
+
+PositionTracker::PositionTracker(Clock *clock)
+  : clock_(clock), playing_(false), just_changed_(true), polled_position_(-1),
+    polled_at_ms_(0), next_poll_ms_(0),
+    poll_in_flight_(false), poll_started_ms_(0), duration_(-1) {
+}
+
+void PositionTracker::TransportChanged(bool playing, bool new_track) {
+  const int64_t now_ms = clock_->NowMillis();
+  if (new_track) {
+    polled_position_ = -1;
+  } else if (polled_position_ >= 0) {
+    // Continue interpolation from where we are now.
+    polled_position_ = Position();
+    polled_at_ms_ = now_ms;
+  }
+  playing_ = playing;
+  just_changed_ = true;
+  next_poll_ms_ = now_ms;   // Poll right away.
+}
+
+bool PositionTracker::StartPollIfDue() {
+  const int64_t now_ms = clock_->NowMillis();
+  if (poll_in_flight_) {
+    if (now_ms - poll_started_ms_ < kPollTimeoutMillis)
+      return false;
+    poll_in_flight_ = false;  // Lost response. Try again.
+  }
+  if (now_ms < next_poll_ms_)
+    return false;
+  poll_in_flight_ = true;
+  poll_started_ms_ = now_ms;
+  return true;
+}
+
+void PositionTracker::PollResult(int position_seconds) {
+  const int64_t now_ms = clock_->NowMillis();
+  poll_in_flight_ = false;
+  polled_position_ = position_seconds;
+  polled_at_ms_ = now_ms;
+  if (position_seconds < 0) {
+    next_poll_ms_ = now_ms + kFailedPollMillis;
+  } else if (just_changed_) {
+    next_poll_ms_ = now_ms + kConfirmPollMillis;
+  } else {
+    next_poll_ms_ = now_ms + (playing_ ? kSteadyPollMillis : kIdlePollMillis);
+  }
+  just_changed_ = false;
+}
+
+int PositionTracker::Position() const {
+  if (polled_position_ < 0)
+    return -1;
+  if (!playing_)
+    return polled_position_;
+  const int position
+    = polled_position_ + (clock_->NowMillis() - polled_at_ms_) / 1000;
+  if (duration_ > 0 && position > duration_)
+    return duration_;
+  return position;
+}
@@ -0,0 +1,70 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_POSITION_TRACKER_
+#define UPNP_DISPLAY_POSITION_TRACKER_
+
+#include <stdint.h>
+
+class Clock;
+
+// Keeps track of the playback position of a renderer.
+//
+// The position ("RelativeTimePosition") is not evented, so it has to be
+// polled with GetPositionInfo. This class decides when that is needed:
+// right after the transport state changed, and then only rarely while
+// playing steadily. In between, the position is interpolated using a local
+// monotonic clock.
+//
+// Pure bookkeeping; time comes from "clock" (not owned), so that playback
+// can be simulated on virtual time. Not thread safe; the owner needs to lock.
+class PositionTracker {
+public:
+  explicit PositionTracker(Clock *clock);
+
+  // The transport state changed. "new_track" if the position from
+  // earlier polls is not valid anymore.
+  void TransportChanged(bool playing, bool new_track);
+
+  // Returns 'true' if the renderer should be polled now. In that case, the
+  // poll is considered in flight until PollResult() is called.
+  bool StartPollIfDue();
+
+  // Result of a poll. Position is -1 if the renderer did not provide it.
+  void PollResult(int position_seconds);
+
+  // Duration of the current track in seconds; -1 if unknown.
+  void set_duration(int seconds) { duration_ = seconds; }
+
+  // Returns the interpolated position in seconds, or -1 if unknown.
+  // Never beyond the end of the track, even if the renderer stalls, e.g.
+  // while buffering or at the end of the track.
+  int Position() const;
+
+private:
+  Clock *const clock_;
+  bool playing_;
+  bool just_changed_;         // No poll since last transport change.
+  int polled_position_;       // Position in seconds at polled_at_ms_.
+  int64_t polled_at_ms_;
+  int64_t next_poll_ms_;
+  bool poll_in_flight_;
+  int64_t poll_started_ms_;
+  int duration_;
+};
+
+#endif  // UPNP_DISPLAY_POSITION_TRACKER_
@@ -18,36 +18,96 @@
 
 #include "printer.h"
 
+#include <assert.h>
 #include <stdio.h>
-#include "utf8.h"
 
 #define SCREEN_CURSOR_UP_FORMAT    "\033[%dA"  // Move cursor up given lines.
 
-std::string Utf8CutPrefix(const std::string &str, int len) {
-  std::string::const_iterator pos = str.begin();
-  while (len > 0 && pos != str.end()) {
-    utf8_next_codepoint(pos);
-    --len;
+// Spans covering all cells of "frame". Returns number of spans.
+static int AllCells(const Frame &frame, Frame::Span *spans) {
+  for (int row = 0; row < frame.height(); ++row) {
+    spans[row].row = row;
+    spans[row].begin = 0;
+    spans[row].end = frame.width();
   }
-  return str.substr(0, pos - str.begin());
+  return frame.height();
 }
 
-void ConsolePrinter::Print(int line, const std::string &raw_text) {
-  if (line > (int)lines_.size()) return;
-  const std::string display_text = Utf8CutPrefix(raw_text, width_);
-  if (lines_[line] == display_text) return;  // no change.
-  lines_[line] = display_text;
+void Printer::SubmitFrame(const Frame &frame) {
+  assert(frame.width() == width() && frame.height() == height());
+  int count;
+  if (has_shown_) {
+    count = frame.Diff(shown_, spans_);
+    if (count == 0) return;  // no change.
+  } else {
+    count = AllCells(frame, spans_);
+  }
+  shown_ = frame;
+  has_shown_ = true;
+  ApplySpans(frame, spans_, count);
+}
+
+void Printer::SubmitFrame(const Frame &frame,
+                          const Frame::Span *spans, int count) {
+  assert(frame.width() == width() && frame.height() == height());
+  if (!has_shown_) {
+    count = AllCells(frame, spans_);
+    spans = spans_;
+  } else if (count == 0) {
+    return;  // no change.
+  }
+  shown_ = frame;
+  has_shown_ = true;
+  ApplySpans(frame, spans, count);
+}
+
+void Printer::Print(int line, const LineBuffer &text) {
+  if (line < 0 || line >= height()) return;
+  if (has_shown_) {
+    scratch_ = shown_;
+  } else {
+    scratch_.Reset(width(), height());
+  }
+  scratch_.SetLine(line, text);
+  SubmitFrame(scratch_);
+}
+
+// Progress bar cells shown with unicode block elements: closest eighths.
+static const Frame::Codepoint kConsoleProgress[Frame::kProgressBarSteps + 1]
+= { ' ', 0x258E, 0x258D, 0x258B, 0x258A, 0x2588 };
+
+void ConsolePrinter::ApplySpans(const Frame &raw_frame,
+                                const Frame::Span *spans, int count) {
+  frame_ = raw_frame;
+  for (int row = 0; row < frame_.height(); ++row) {
+    for (int col = 0; col < frame_.width(); ++col) {
+      const Frame::Codepoint cp = frame_.at(row, col);
+      if (cp >= Frame::kProgressBar
+          && cp <= Frame::kProgressBar + Frame::kProgressBarSteps) {
+        frame_.set(row, col, kConsoleProgress[cp - Frame::kProgressBar]);
+      }
+    }
+  }
+  const Frame &frame = frame_;
 
   if (!in_place_) {
-    printf("[%d]: %s\n", line, display_text.c_str());
+    // Spans come ordered by row; print each changed line once.
+    int last_row = -1;
+    for (int i = 0; i < count; ++i) {
+      if (spans[i].row == last_row) continue;
+      last_row = spans[i].row;
+      frame.GetLine(last_row, &line_);
+      printf("[%d]: %s\n", last_row, line_.data());
+    }
     return;
   }
   if (needs_jump_) {
-    printf(SCREEN_CURSOR_UP_FORMAT, (int)lines_.size());
+    printf(SCREEN_CURSOR_UP_FORMAT, height_);
   }
-  for (size_t i = 0; i < lines_.size(); ++i) {
+  for (int row = 0; row < height_; ++row) {
+    frame.GetLine(row, &line_);
     printf("%*s\r", width_, "");  // Clear possible last text
-    printf("%s\n", lines_[i].c_str());
+    printf("%s\n", line_.data());
   }
   needs_jump_ = true;
 }
@@ -19,21 +19,67 @@
 #define UPNP_DISPLAY_PRINTER_
 
 #include <string>
-#include <vector>
+
+#include "frame.h"
+#include "line-buffer.h"
 
 // Interface for a simple display.
+//
+// Content is submitted as whole Frame. The printer compares it with what
+// is shown and passes only the changed cells to the implementation.
 class Printer {
 public:
+  // Maximum number of lines we support on a display.
+  static const int kMaxHeight = Frame::kMaxHeight;
+
+  Printer() : has_shown_(false) {}
   virtual ~Printer() {}
 
   virtual int width() const { return 16; }
+  virtual int height() const { return 2; }
+
+  // Returns 'true' if the printer shows the pixel shift of frames (see
+  // Frame::SetPixelShift()).
+  virtual bool supports_pixel_shift() const { return false; }
+
+  // Returns 'true' if the printer can show the codepoint. Text with other
+  // characters is transliterated if possible.
+  virtual bool CanShow(Frame::Codepoint) const { return true; }
+
+  // Show "frame", which has the size of this display. Text is given as
+  // Unicode codepoints, the printer has to attempt to try its best to
+  // display it.
+  void SubmitFrame(const Frame &frame);
 
-  // Print line. The text is given in UTF-8, the printer has to attempt
-  // to try its best to display it.
-  virtual void Print(int line, const std::string &text) = 0;
+  // Like SubmitFrame(), for callers that know already where "frame"
+  // differs from the previously submitted one, e.g. a printer passing its
+  // frames on: the "count" "spans" cover all changed cells, and maybe more.
+  void SubmitFrame(const Frame &frame, const Frame::Span *spans, int count);
+
+  // Convenience: replace just one line of what is shown. The text is given
+  // in UTF-8.
+  void Print(int line, const LineBuffer &text);
+  void Print(int line, const std::string &text) {
+    Print(line, LineBuffer(text));
+  }
 
   // Put screen in sleep mode if possible.
   virtual void SaveScreen() = 0;
+
+protected:
+  // Update the display with the "count" changed "spans" of "frame". The
+  // first call after construction or InvalidateFrame() has all cells dirty.
+  virtual void ApplySpans(const Frame &frame,
+                          const Frame::Span *spans, int count) = 0;
+
+  // Forget what is on the display; next frame updates all cells.
+  void InvalidateFrame() { has_shown_ = false; }
+
+private:
+  bool has_shown_;
+  Frame shown_;                   // What is currently on the display.
+  Frame scratch_;                 // For Print().
+  Frame::Span spans_[Frame::kMaxHeight * ((Frame::kMaxWidth + 1) / 2)];
 };
 
 // Very simple implementation of the above, mostly for debugging. Just prints
@@ -43,16 +89,23 @@ public:
   // 'in_place': refresh in place, otherwise just print line if changed.
   // width and height in characters.
   ConsolePrinter(bool in_place, int width, int height)
-    : in_place_(in_place), width_(width), needs_jump_(false), lines_(height) {}
+    : in_place_(in_place), width_(width), height_(height),
+      needs_jump_(false) {}
   virtual int width() const { return width_; }
-  virtual void Print(int line, const std::string &text);
+  virtual int height() const { return height_; }
   virtual void SaveScreen() {}
 
+protected:
+  virtual void ApplySpans(const Frame &frame,
+                          const Frame::Span *spans, int count);
+
 private:
   const bool in_place_;
   const int width_;
+  const int height_;
   bool needs_jump_;
-  std::vector<std::string> lines_;
+  Frame frame_;       // With console replacements for special characters.
+  LineBuffer line_;
 };
 
 #endif  // UPNP_DISPLAY_PRINTER_
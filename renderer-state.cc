@@ -21,11 +21,14 @@
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include <upnp.h>
 #include <upnptools.h>
 #include <pthread.h>
 
+#include "clock.h"
+
 // Prefix, as these can be followed by changing version number.
 static const char kTransportServicePrefix[] =
 	"urn:schemas-upnp-org:service:AVTransport:";
@@ -63,13 +66,77 @@ static const char *find_first_content(IXML_Document *doc, const char *name) {
   return result;
 }
 
-RendererState::RendererState(const char *uuid, FILE *logstream)
-  : uuid_(uuid), logstream_(logstream), descriptor_(NULL), subscriptions_(NULL),
-    last_event_update_(time(NULL)) {
+// Parse UPnP time "H+:MM:SS[.F+]" into seconds. Returns -1 if not
+// parseable, e.g. for "NOT_IMPLEMENTED".
+static int ParseUpnpTime(const char *upnp_time) {
+  int hour, minute, second;
+  if (upnp_time == NULL
+      || sscanf(upnp_time, "%d:%d:%d", &hour, &minute, &second) != 3)
+    return -1;
+  return hour * 3600 + minute * 60 + second;
+}
+
+// An asynchronous action in flight; cookie for the upnp library callback.
+struct RendererState::PendingAction {
+  enum Kind { GET_POSITION_INFO, QUERY_VARIABLES };
+
+  RendererState *renderer;
+  Kind kind;
+  const ResultVariable *result_vars;  // QUERY_VARIABLES: what to store.
+  unsigned int sequence;              // event_sequence_ when sent.
+};
+
+// Mapping of action result arguments to the evented variable names.
+struct RendererState::ResultVariable {
+  const char *argument;
+  const char *variable;
+  bool fallback;      // Only used if the variable has no value at all yet.
+};
+
+static const RendererState::ResultVariable kTransportInfoResult[] = {
+  { "CurrentTransportState", "TransportState", false },
+  { NULL, NULL, false }
+};
+
+static const RendererState::ResultVariable kMediaInfoResult[] = {
+  { "CurrentURI",         "AVTransportURI", false },
+  { "CurrentURIMetaData", "AVTransportURIMetaData", false },
+  // For single tracks, the media is the track. For playlists it is not,
+  // so this must never replace track metadata we got from an event.
+  { "CurrentURIMetaData", "CurrentTrackMetaData", true },
+  { "NextURI",            "NextAVTransportURI", false },
+  { "NextURIMetaData",    "NextAVTransportURIMetaData", false },
+  { "MediaDuration",      "CurrentMediaDuration", false },
+  { NULL, NULL, false }
+};
+
+static const RendererState::ResultVariable kVolumeResult[] = {
+  { "CurrentVolume", "Volume", false },
+  { NULL, NULL, false }
+};
+
+static const RendererState::ResultVariable kMuteResult[] = {
+  { "CurrentMute", "Mute", false },
+  { NULL, NULL, false }
+};
+
+RendererState::RendererState(const char *uuid, Clock *clock, FILE *logstream)
+  : uuid_(uuid), clock_(clock), logstream_(logstream), descriptor_(NULL),
+    subscriptions_(NULL), upnp_controller_(-1),
+    last_event_update_(clock->NowMillis()), event_sequence_(0),
+    position_(clock), pending_actions_(0) {
   pthread_mutex_init(&variable_mutex_, NULL);
+  pthread_cond_init(&actions_done_, NULL);
 }
 
 RendererState::~RendererState() {
+  // Callbacks of outstanding actions still reference us.
+  pthread_mutex_lock(&variable_mutex_);
+  while (pending_actions_ > 0) {
+    pthread_cond_wait(&actions_done_, &variable_mutex_);
+  }
+  pthread_mutex_unlock(&variable_mutex_);
+
   if (descriptor_) ixmlDocument_free(descriptor_);
   for (size_t i = 0; i < subscription_ids_.size(); ++i) {
     subscriptions_->erase(subscription_ids_[i]);
@@ -77,11 +144,18 @@ RendererState::~RendererState() {
 }
 
 bool RendererState::InitDescription(const char *description_url) {
-  assert(descriptor_ == NULL);  // call this only once.
-  if (UpnpDownloadXmlDoc(description_url, &descriptor_) != UPNP_E_SUCCESS) {
+  IXML_Document *descriptor = NULL;
+  if (UpnpDownloadXmlDoc(description_url, &descriptor) != UPNP_E_SUCCESS) {
     fprintf(logstream_, "Can't read service description: %s\n", description_url);
     return false;
   }
+  return InitDescription(description_url, descriptor);
+}
+
+bool RendererState::InitDescription(const char *description_url,
+                                    IXML_Document *descriptor) {
+  assert(descriptor_ == NULL);  // call this only once.
+  descriptor_ = descriptor;
 
   const char *base_url = find_first_content(descriptor_, "URLBase");
   if (base_url != NULL) {
@@ -102,6 +176,12 @@ bool RendererState::InitDescription(const char *description_url) {
   return true;
 }
 
+std::string RendererState::ResolveUrl(const char *url) const {
+  if (strncmp(url, "http://", 7) == 0 || strncmp(url, "https://", 8) == 0)
+    return url;
+  return base_url_ + (url[0] == '/' ? url + 1 : url);
+}
+
 static bool prefixMatch(const char *str, const char *prefix) {
   return strncmp(str, prefix, strlen(prefix)) == 0;
 }
@@ -111,6 +191,7 @@ bool RendererState::SubscribeTo(UpnpClient_Handle upnp_controller,
 
   assert(subscriptions_ == NULL); // .. but not yet subscribed
   subscriptions_ = submap;
+  upnp_controller_ = upnp_controller;
 
   IXML_NodeList *service_list = NULL;
   service_list = ixmlDocument_getElementsByTagName(descriptor_, "serviceList");
@@ -134,6 +215,17 @@ bool RendererState::SubscribeTo(UpnpClient_Handle upnp_controller,
     const char *service_type = find_first_content(it->nodeItem, "serviceType");
     if (service_type == NULL) continue;
     const char *event_url = find_first_content(it->nodeItem, "eventSubURL");
+    const char *control_url = find_first_content(it->nodeItem, "controlURL");
+
+    if (prefixMatch(service_type, kTransportServicePrefix) && control_url) {
+      // Remember for active queries.
+      transport_service_type_ = service_type;
+      transport_control_url_ = ResolveUrl(control_url);
+    }
+    if (prefixMatch(service_type, kRenderControlPrefix) && control_url) {
+      render_service_type_ = service_type;
+      render_control_url_ = ResolveUrl(control_url);
+    }
 
     if (prefixMatch(service_type, kTransportServicePrefix) ||
         prefixMatch(service_type, kRenderControlPrefix)) {
@@ -142,13 +234,43 @@ bool RendererState::SubscribeTo(UpnpClient_Handle upnp_controller,
   }
   ixmlNodeList_free(service_it);
 
+  if (success) QueryInitialState();
+
   return success;
 }
 
+void RendererState::QueryInitialState() {
+  // The initial event might take a while or be incomplete. All queries are
+  // in flight in parallel; ReceiveQueriedVariables() makes sure that we
+  // don't overwrite values from events that arrive in the meantime.
+  if (!transport_control_url_.empty()) {
+    const char *type = transport_service_type_.c_str();
+    SendAction(PendingAction::QUERY_VARIABLES, kTransportInfoResult,
+               transport_service_type_, transport_control_url_,
+               UpnpMakeAction("GetTransportInfo", type,
+                              1, "InstanceID", "0"));
+    SendAction(PendingAction::QUERY_VARIABLES, kMediaInfoResult,
+               transport_service_type_, transport_control_url_,
+               UpnpMakeAction("GetMediaInfo", type,
+                              1, "InstanceID", "0"));
+  }
+  if (!render_control_url_.empty()) {
+    const char *type = render_service_type_.c_str();
+    SendAction(PendingAction::QUERY_VARIABLES, kVolumeResult,
+               render_service_type_, render_control_url_,
+               UpnpMakeAction("GetVolume", type,
+                              2, "InstanceID", "0", "Channel", "Master"));
+    SendAction(PendingAction::QUERY_VARIABLES, kMuteResult,
+               render_service_type_, render_control_url_,
+               UpnpMakeAction("GetMute", type,
+                              2, "InstanceID", "0", "Channel", "Master"));
+  }
+}
+
 bool RendererState::Subscribe(UpnpClient_Handle upnp_controller,
                               const char *service_type,
                               const char *event_url) {
-  std::string url = base_url_ + (event_url + 1);
+  std::string url = ResolveUrl(event_url);
   int timeout;
   Upnp_SID sid;
   int rc = UpnpSubscribe(upnp_controller, url.c_str(), &timeout, sid);
@@ -166,30 +288,169 @@ bool RendererState::Subscribe(UpnpClient_Handle upnp_controller,
 
 std::string RendererState::GetVar(const std::string &name) const {
   std::string result;
+  GetVar(name, &result);
+  return result;
+}
+
+void RendererState::GetVar(const std::string &name,
+                           std::string *result) const {
   pthread_mutex_lock(&variable_mutex_);
   VariableMap::const_iterator found = variables_.find(name);
   if (found != variables_.end()) {
-    result = found->second;
+    result->assign(found->second);
+  } else {
+    result->clear();
   }
   pthread_mutex_unlock(&variable_mutex_);
+}
+
+int64_t RendererState::last_event_update() const {
+  pthread_mutex_lock(&variable_mutex_);
+  const int64_t result = last_event_update_;
+  pthread_mutex_unlock(&variable_mutex_);
   return result;
 }
 
-time_t RendererState::last_event_update() const {
+int RendererState::GetPlaybackPosition() const {
   pthread_mutex_lock(&variable_mutex_);
-  time_t result = last_event_update_;
+  const int result = position_.Position();
   pthread_mutex_unlock(&variable_mutex_);
   return result;
 }
 
-void RendererState::DecodeMetaAndInsertData_Locked(const char *didl_xml) {
-  variables_["Meta_Title"] = "";
-  variables_["Meta_Artist"] = "";
-  variables_["Meta_Composer"] = "";
-  variables_["Meta_Creator"] = "";
-  variables_["Meta_Album"] = "";
-  variables_["Meta_Genre"] = "";
-  variables_["Meta_Year"] = "";
+bool RendererState::PollPositionIfDue() {
+  pthread_mutex_lock(&variable_mutex_);
+  const bool needs_poll = (!transport_control_url_.empty()
+                           && position_.StartPollIfDue());
+  pthread_mutex_unlock(&variable_mutex_);
+  if (needs_poll) {
+    SendPositionPoll();
+  }
+  return needs_poll;
+}
+
+void RendererState::SendPositionPoll() {
+  IXML_Document *action
+    = UpnpMakeAction("GetPositionInfo", transport_service_type_.c_str(),
+                     1, "InstanceID", "0");
+  SendAction(PendingAction::GET_POSITION_INFO, NULL,
+             transport_service_type_, transport_control_url_, action);
+}
+
+void RendererState::SendAction(int kind, const ResultVariable *result_vars,
+                               const std::string &service_type,
+                               const std::string &control_url,
+                               IXML_Document *action) {
+  PendingAction *pending = new PendingAction();
+  pending->renderer = this;
+  pending->kind = static_cast<PendingAction::Kind>(kind);
+  pending->result_vars = result_vars;
+  pthread_mutex_lock(&variable_mutex_);
+  pending->sequence = event_sequence_;
+  ++pending_actions_;
+  pthread_mutex_unlock(&variable_mutex_);
+
+  const int rc = UpnpSendActionAsync(upnp_controller_, control_url.c_str(),
+                                     service_type.c_str(), NULL,
+                                     action, &ActionComplete, pending);
+  ixmlDocument_free(action);
+  if (rc != UPNP_E_SUCCESS) {
+    fprintf(logstream_, "Action: %s %s rc=%d\n",
+            friendly_name_.c_str(), UpnpGetErrorMessage(rc), rc);
+    ActionComplete(UPNP_CONTROL_ACTION_COMPLETE, NULL, pending);
+  }
+}
+
+int RendererState::ActionComplete(Upnp_EventType_e event,
+                                  const void *event_data, void *cookie) {
+  PendingAction *pending = static_cast<PendingAction*>(cookie);
+  RendererState *const renderer = pending->renderer;
+
+  // NULL result on any error.
+  IXML_Document *result = NULL;
+  if (event == UPNP_CONTROL_ACTION_COMPLETE && event_data != NULL) {
+    const UpnpActionComplete *complete
+      = static_cast<const UpnpActionComplete*>(event_data);
+    if (UpnpActionComplete_get_ErrCode(complete) == UPNP_E_SUCCESS) {
+      result = UpnpActionComplete_get_ActionResult(complete);
+    }
+  }
+
+  switch (pending->kind) {
+  case PendingAction::GET_POSITION_INFO:
+    renderer->ReceivePositionInfo(result);
+    break;
+  case PendingAction::QUERY_VARIABLES:
+    if (result != NULL) {
+      renderer->ReceiveQueriedVariables(result, pending->result_vars,
+                                        pending->sequence);
+    }
+    break;
+  }
+  delete pending;
+
+  pthread_mutex_lock(&renderer->variable_mutex_);
+  if (--renderer->pending_actions_ == 0) {
+    pthread_cond_broadcast(&renderer->actions_done_);
+  }
+  pthread_mutex_unlock(&renderer->variable_mutex_);
+  return UPNP_E_SUCCESS;
+}
+
+void RendererState::ReceivePositionInfo(IXML_Document *result) {
+  int position = -1;
+  const char *duration = NULL;
+  if (result != NULL) {
+    position = ParseUpnpTime(find_first_content(result, "RelTime"));
+    duration = find_first_content(result, "TrackDuration");
+  }
+  pthread_mutex_lock(&variable_mutex_);
+  position_.PollResult(position);
+  // Some renderers don't event the duration; we get it here for free.
+  if (ParseUpnpTime(duration) > 0) {
+    variables_["CurrentTrackDuration"] = duration;
+    position_.set_duration(ParseUpnpTime(duration));
+  }
+  pthread_mutex_unlock(&variable_mutex_);
+}
+
+void RendererState::ReceiveQueriedVariables(IXML_Document *result,
+                                            const ResultVariable *vars,
+                                            unsigned int sequence) {
+  VariableChanges changes;
+  pthread_mutex_lock(&variable_mutex_);
+  for (const ResultVariable *v = vars; v->argument != NULL; ++v) {
+    const char *value = find_first_content(result, v->argument);
+    if (value == NULL) continue;
+    // Events that arrived after we asked are more recent. Keep them.
+    VariableSequence::const_iterator found = variable_sequence_.find(
+      v->variable);
+    if (found != variable_sequence_.end() && found->second > sequence)
+      continue;
+    if (v->fallback) {
+      // Any event, even an earlier one, knows better.
+      VariableMap::const_iterator stored = variables_.find(v->variable);
+      if (found != variable_sequence_.end()
+          || (stored != variables_.end() && !stored->second.empty()))
+        continue;
+    }
+    UpdateVariable_Locked(v->variable, value, &changes);
+  }
+  ApplyChanges_Locked(changes);
+  last_event_update_ = clock_->NowMillis();
+  pthread_mutex_unlock(&variable_mutex_);
+}
+
+// Decode DIDL data into "meta". Fields not present are left empty.
+static void DecodeTrackMetadata(const char *didl_xml,
+                                RendererState::TrackMetadata *meta) {
+  meta->title.clear();
+  meta->artist.clear();
+  meta->composer.clear();
+  meta->creator.clear();
+  meta->album.clear();
+  meta->genre.clear();
+  meta->year.clear();
 
   IXML_Document *doc = ixmlParseBuffer(didl_xml);
   if (doc == NULL)
@@ -197,12 +458,18 @@ void RendererState::DecodeMetaAndInsertData_Locked(const char *didl_xml) {
 
   IXML_NodeList *list = NULL;
   list = ixmlDocument_getElementsByTagName(doc, "DIDL-Lite");
-  if (list == NULL) return;
+  if (list == NULL) {
+    ixmlDocument_free(doc);
+    return;
+  }
   IXML_Node *toplevel = list->nodeItem;
   ixmlNodeList_free(list);
 
   list = ixmlElement_getElementsByTagName((IXML_Element*)toplevel, "item");
-  if (list == NULL) return;
+  if (list == NULL) {
+    ixmlDocument_free(doc);
+    return;
+  }
   IXML_Node *item_element = list->nodeItem;
   ixmlNodeList_free(list);
 
@@ -214,45 +481,128 @@ void RendererState::DecodeMetaAndInsertData_Locked(const char *didl_xml) {
     const char *value = get_node_content(it->nodeItem);
     if (!value) continue;
     if (strcmp("dc:title", name) == 0) {
-      variables_["Meta_Title"] = value;
+      meta->title = value;
     } else if (strcmp("upnp:artist", name) == 0) {
       const char *qualifier
         = ixmlElement_getAttribute((IXML_Element*) it->nodeItem, "role");
       if (qualifier != NULL && strcmp(qualifier, "Composer") == 0) {
-        variables_["Meta_Composer"] = value;
+        meta->composer = value;
       } else if (qualifier != NULL && strcmp(qualifier, "AlbumArtist") == 0) {
         album_artist = value;
       } else {
-        variables_["Meta_Artist"] = value;
+        meta->artist = value;
       }
     } else if (strcmp("upnp:album", name) == 0) {
-      variables_["Meta_Album"] = value;
+      meta->album = value;
     } else if (strcmp("upnp:genre", name) == 0) {
-      variables_["Meta_Genre"] = value;
+      meta->genre = value;
     } else if (strcmp("upnp:composer", name) == 0) {
-      variables_["Meta_Composer"] = value;
+      meta->composer = value;
     } else if (strcmp("dc:creator", name) == 0) {
-      variables_["Meta_Creator"] = value;
+      meta->creator = value;
     } else if (strcmp("dc:date", name) == 0) {
-      variables_["Meta_Year"] = value;
-      if (variables_["Meta_Year"].size() == 10) {  // proper ISO8601
-        variables_["Meta_Year"].resize(4);
+      meta->year = value;
+      if (meta->year.size() == 10) {  // proper ISO8601
+        meta->year.resize(4);
       }
     }
   }
 
   // If we don't have a specific artist, take the generic artist of the album.
-  if (variables_["Meta_Artist"].empty() && !album_artist.empty()) {
-    variables_["Meta_Artist"] = album_artist;
+  if (meta->artist.empty() && !album_artist.empty()) {
+    meta->artist = album_artist;
   }
 
   ixmlNodeList_free(variable_list);
   ixmlDocument_free(doc);
 }
 
+void RendererState::InsertTrackMetadata_Locked(const TrackMetadata &meta) {
+  variables_["Meta_Title"] = meta.title;
+  variables_["Meta_Artist"] = meta.artist;
+  variables_["Meta_Composer"] = meta.composer;
+  variables_["Meta_Creator"] = meta.creator;
+  variables_["Meta_Album"] = meta.album;
+  variables_["Meta_Genre"] = meta.genre;
+  variables_["Meta_Year"] = meta.year;
+}
+
+void RendererState::ReceiveTrackChange_Locked(const char *track_uri,
+                                              const char *current_meta_xml) {
+  const bool have_next = !next_track_.didl_xml.empty();
+  if (current_meta_xml != NULL) {
+    if (have_next && next_track_.didl_xml == current_meta_xml) {
+      InsertTrackMetadata_Locked(next_track_.meta);   // Already decoded.
+      next_track_.didl_xml.clear();
+    } else {
+      TrackMetadata meta;
+      DecodeTrackMetadata(current_meta_xml, &meta);
+      InsertTrackMetadata_Locked(meta);
+    }
+  } else if (track_uri != NULL && have_next && next_track_.uri == track_uri) {
+    // Renderer moved on to the track we prefetched; its metadata
+    // might only arrive in a later event, but we already know it.
+    InsertTrackMetadata_Locked(next_track_.meta);
+    variables_["CurrentTrackMetaData"].swap(next_track_.didl_xml);
+    next_track_.didl_xml.clear();
+  }
+}
+
+RendererState::VariableChanges::VariableChanges()
+  : transport_changed(false), track_uri(NULL), current_meta_xml(NULL),
+    next_uri(NULL), next_meta_xml(NULL) {
+}
+
+void RendererState::UpdateVariable_Locked(const char *name, const char *value,
+                                          VariableChanges *changes) {
+  std::string &stored = variables_[name];
+  if (stored == value) return;
+  if (strcmp(name, "TransportState") == 0) {
+    changes->transport_changed = true;
+  } else if (strcmp(name, "CurrentTrackURI") == 0
+             || strcmp(name, "AVTransportURI") == 0) {
+    changes->track_uri = value;
+  } else if (strcmp(name, "CurrentTrackMetaData") == 0) {
+    changes->current_meta_xml = value;
+  } else if (strcmp(name, "NextAVTransportURI") == 0) {
+    changes->next_uri = value;
+  } else if (strcmp(name, "NextAVTransportURIMetaData") == 0) {
+    changes->next_meta_xml = value;
+  } else if (strcmp(name, "CurrentTrackDuration") == 0) {
+    position_.set_duration(ParseUpnpTime(value));
+  }
+  stored = value;
+}
+
+void RendererState::ApplyChanges_Locked(const VariableChanges &changes) {
+  // First move to the new track, possibly the one we prepared earlier...
+  ReceiveTrackChange_Locked(changes.track_uri, changes.current_meta_xml);
+
+  // ... then prepare the next one, so that it is ready when it starts.
+  if (changes.next_uri != NULL) {
+    next_track_.uri = changes.next_uri;
+    if (changes.next_meta_xml == NULL)
+      next_track_.didl_xml.clear();  // outdated.
+  }
+  if (changes.next_meta_xml != NULL) {
+    next_track_.didl_xml = changes.next_meta_xml;
+    DecodeTrackMetadata(changes.next_meta_xml, &next_track_.meta);
+  }
+
+  const bool new_track = (changes.track_uri != NULL);
+  if (changes.transport_changed || new_track) {
+    position_.TransportChanged(variables_["TransportState"] == "PLAYING",
+                               new_track);
+  }
+}
+
 void RendererState::ReceiveEvent(const UpnpEvent *data) {
     const char *as_string = find_first_content(
         UpnpEvent_get_ChangedVariables(data), "LastChange");
+  ReceiveLastChange(as_string);
+}
+
+void RendererState::ReceiveLastChange(const char *as_string) {
   //fprintf(logstream_, "Got variable changes: %s\n", as_string);
   IXML_Document *doc = ixmlParseBuffer(as_string);
   if (doc == NULL) {
@@ -265,17 +615,19 @@ void RendererState::ReceiveEvent(const UpnpEvent *data) {
   IXML_Node *instance_element = instance_list->nodeItem;  // interested in 1st
   ixmlNodeList_free(instance_list);
   IXML_NodeList *variable_list = ixmlNode_getChildNodes(instance_element);
+  VariableChanges changes;
   pthread_mutex_lock(&variable_mutex_);
+  ++event_sequence_;
   for (const IXML_NodeList *it = variable_list; it; it = it->next) {
     const char *name = ixmlNode_getNodeName(it->nodeItem);
     const char *value
       = ixmlElement_getAttribute((IXML_Element*) it->nodeItem, "val");
-    variables_[name] = value;
-    if (strcmp(name, "CurrentTrackMetaData") == 0) {
-      DecodeMetaAndInsertData_Locked(value);
-    }
+    if (value == NULL) continue;
+    variable_sequence_[name] = event_sequence_;
+    UpdateVariable_Locked(name, value, &changes);
   }
-  last_event_update_ = time(NULL);
+  ApplyChanges_Locked(changes);
+  last_event_update_ = clock_->NowMillis();
   pthread_mutex_unlock(&variable_mutex_);
   ixmlNodeList_free(variable_list);
   ixmlDocument_free(doc);
@@ -27,23 +27,47 @@
 #include <time.h>
 #include <upnp.h>
 
+#include "position-tracker.h"
+
+class Clock;
+
 // Representing the state for a particular renderer.
 class RendererState {
 public:
   typedef std::map<std::string, RendererState *> SubscriptionMap;
 
-  RendererState(const char *uuid, FILE *logstream);
+  // The playback position is interpolated and events are time-stamped
+  // with "clock" (not owned). The upnp callback threads use it too, so it
+  // needs to be thread safe.
+  RendererState(const char *uuid, Clock *clock, FILE *logstream);
   ~RendererState();
 
   // -- method calls interesting for users.
   // Returns the human readable name of the renderer (e.g. "Living Room")
-  const std::string friendly_name() const { return friendly_name_; }
+  const std::string &friendly_name() const { return friendly_name_; }
 
   // Get variable with given name. Text is encoded in UTF-8.
   // Thread safe.
   std::string GetVar(const std::string &name) const;
 
-  time_t last_event_update() const;
+  // Like GetVar() above, but copies into an existing string, re-using its
+  // storage. That way, polling variables does not need to allocate.
+  void GetVar(const std::string &name, std::string *result) const;
+
+  // Clock time in milliseconds when we last received variables.
+  int64_t last_event_update() const;
+
+  // Returns the current playback position in seconds or -1 if not known.
+  // The position is interpolated locally from the last poll, so this
+  // neither allocates nor touches the network. Thread safe.
+  int GetPlaybackPosition() const;
+
+  // If the last known position is too old, send an asynchronous
+  // GetPositionInfo poll to the renderer. Returns 'true' if a poll was
+  // sent. Called regularly by the controller's poll thread; unlike
+  // GetPlaybackPosition(), it allocates and does network I/O, so keep it
+  // away from the display update. Thread safe.
+  bool PollPositionIfDue();
 
   // -- method calls used for internal upnp subscription management.
 
@@ -51,6 +75,12 @@ public:
   // the renderer web-service.
   bool InitDescription(const char *descriptior_url);
 
+  // Like InitDescription() above, with the description already downloaded
+  // (takes ownership of "descriptor"). Tests use it to set up a renderer
+  // without network.
+  bool InitDescription(const char *descriptior_url,
+                       IXML_Document *descriptor);
+
   // Register interest in variables.
   // TODO: this needs to be handled by a subscription manager or something.
   // It breaks the encapsulation that this stores itself in the subscription_map.
@@ -60,16 +90,94 @@ public:
   // Callback from controller when changed variables arrive.
   void ReceiveEvent(const UpnpEvent *data);
 
+  // Apply the "LastChange" XML of an event. Called by ReceiveEvent();
+  // tests can use it to play renderer without network.
+  void ReceiveLastChange(const char *last_change_xml);
+
+  // Apply a GetPositionInfo response (NULL on error). Called when a
+  // position poll completes; tests can use it to set the position.
+  void ReceivePositionInfo(IXML_Document *result);
+
+  // Metadata decoded from DIDL-Lite XML.
+  struct TrackMetadata {
+    std::string title;
+    std::string artist;
+    std::string composer;
+    std::string creator;
+    std::string album;
+    std::string genre;
+    std::string year;
+  };
+
+  // Maps an action result argument to a variable; used internally.
+  struct ResultVariable;
+
 private:
+  struct PendingAction;
+
+  // Variables changed in one event or action result, pointing into the XML
+  // document. NULL if unchanged.
+  struct VariableChanges {
+    VariableChanges();
+    bool transport_changed;
+    const char *track_uri;
+    const char *current_meta_xml;
+    const char *next_uri;
+    const char *next_meta_xml;
+  };
+
   bool Subscribe(UpnpClient_Handle upnp_controller,
                  const char *service_type,
                  const char *event_url);
 
-  // Decode DIDL data and insert as Meta_Title, Meta_Artist, Meta_Composer.
+  // Make an absolute URL from an URL in the service description.
+  std::string ResolveUrl(const char *url) const;
+
+  // Send a GetPositionInfo request. Response is handled asynchronously.
+  void SendPositionPoll();
+
+  // Asynchronously query the initial state, so that we don't have to wait
+  // for the first event.
+  void QueryInitialState();
+
+  // Send an action (takes ownership) of PendingAction::Kind "kind". If
+  // "result_vars" is given, these are stored from the result.
+  void SendAction(int kind, const ResultVariable *result_vars,
+                  const std::string &service_type,
+                  const std::string &control_url,
+                  IXML_Document *action);
+
+  // Callback from upnp library when an action completed.
+  static int ActionComplete(Upnp_EventType_e event, const void *event_data,
+                            void *cookie);
+
+  // Store variables from an action result, unless an event updated them
+  // after the action was sent at event "sequence".
+  void ReceiveQueriedVariables(IXML_Document *result,
+                               const ResultVariable *vars,
+                               unsigned int sequence);
+
+  // Set variable and record interesting changes.
+  // requires variable_mutex_ to be locked.
+  void UpdateVariable_Locked(const char *name, const char *value,
+                             VariableChanges *changes);
+
+  // Act on changes, e.g. decode new metadata.
   // requires variable_mutex_ to be locked.
-  void DecodeMetaAndInsertData_Locked(const char *xml);
+  void ApplyChanges_Locked(const VariableChanges &changes);
+
+  // Insert metadata as Meta_Title, Meta_Artist, Meta_Composer etc.
+  // requires variable_mutex_ to be locked.
+  void InsertTrackMetadata_Locked(const TrackMetadata &meta);
+
+  // Update metadata after the track URI and/or metadata changed (each NULL
+  // if unchanged). Uses the prefetched next track if it matches.
+  // requires variable_mutex_ to be locked.
+  void ReceiveTrackChange_Locked(const char *track_uri,
+                                 const char *current_meta_xml);
 
   const std::string uuid_;
+  Clock *const clock_;
   FILE* const logstream_;
 
   std::string friendly_name_;
@@ -80,9 +188,39 @@ private:
 
   std::vector<std::string> subscription_ids_;
 
+  // Initialized in SubscribeTo().
+  UpnpClient_Handle upnp_controller_;
+  std::string transport_service_type_;
+  std::string transport_control_url_;
+  std::string render_service_type_;
+  std::string render_control_url_;
+
   mutable pthread_mutex_t variable_mutex_;
   typedef std::map<std::string, std::string> VariableMap;
-  time_t last_event_update_;
+  int64_t last_event_update_;
   VariableMap variables_;
+
+  // Each event gets a new sequence number; per variable, we remember the
+  // last event that set it.
+  typedef std::map<std::string, unsigned int> VariableSequence;
+  unsigned int event_sequence_;
+  VariableSequence variable_sequence_;
+
+  PositionTracker position_;           // Protected by variable_mutex_.
+
+  // Upcoming track as announced in NextAVTransportURI{,MetaData}, already
+  // decoded so that we can switch to it without delay.
+  // Protected by variable_mutex_.
+  struct NextTrack {
+    std::string uri;
+    std::string didl_xml;         // Empty if nothing prefetched.
+    TrackMetadata meta;
+  };
+  NextTrack next_track_;
+
+  // Outstanding asynchronous actions. We have to wait for them to finish
+  // before we can go away.
+  int pending_actions_;                // Protected by variable_mutex_.
+  pthread_cond_t actions_done_;
 };
 #endif // RENDERER_STATE_H
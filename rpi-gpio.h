@@ -0,0 +1,45 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+#ifndef RPI_GPIO_H
+#define RPI_GPIO_H
+
+#include "gpio.h"
+
+// GPIO of the Raspberry Pi, accessed through its registers.
+// For now, everything is initialized as output.
+class RPiGPIO : public GPIO {
+ public:
+  // Available bits that actually have pins.
+  static const uint32_t kValidBits;
+
+  RPiGPIO();
+
+  virtual bool Init();
+  virtual uint32_t InitOutputs(uint32_t outputs);
+  virtual bool SwitchToInputs(uint32_t bits);
+  virtual void SwitchToOutputs(uint32_t bits);
+
+  virtual uint32_t Read() {
+    return gpio_port_[0x34 / sizeof(uint32_t)];
+  }
+
+  virtual void SetBits(uint32_t value) {
+    gpio_port_[0x1C / sizeof(uint32_t)] = value;
+  }
+
+  virtual void ClearBits(uint32_t value) {
+    gpio_port_[0x28 / sizeof(uint32_t)] = value;
+  }
+
+  virtual void Write(uint32_t value) {
+    // Writing a word is two operations. The IO is actually pretty slow, so
+    // this should probably  be unnoticable.
+    SetBits(value & output_bits_);
+    ClearBits(~value & output_bits_);
+  }
+
+ private:
+  uint32_t output_bits_;
+  volatile uint32_t *gpio_port_;
+};
+
+#endif  // RPI_GPIO_H
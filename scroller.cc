@@ -23,72 +23,115 @@
 static const int kBorderWait = 4;  // ticks to wait at end-of-scroll
 
 Scroller::Scroller(const std::string &interlude)
-  : interlude_(interlude), characters_on_screen_(0), scroll_timeout_(0) {}
-
-void Scroller::InitIterators() {
-  print_start_ = scroll_content_.begin();
-  print_end_ = print_start_;
-  int i;
-  for (i = 0;
-       i < width_ && print_end_ != scroll_content_.end();
-       ++i, utf8_next_codepoint(print_end_)) {
-  }
-  characters_on_screen_ = i;
+  : interlude_(interlude), width_(0), scrolling_needed_(false),
+    content_chars_(0), cycle_chars_(0), tick_(0), value_changed_(true) {
+  Slice empty = { 0, 0, 0, false };
+  frames_.push_back(empty);
 }
 
-void Scroller::SetValue(std::string &content, int width) {
-  if (content != orig_content_ || width != width_) {
-    orig_content_ = content;
-    scroll_content_ = orig_content_;
-    width_ = width;
-    InitIterators();
-    scrolling_needed_ = (print_end_ != scroll_content_.end());
-    if (scrolling_needed_) {
-      scroll_content_ = orig_content_ + interlude_;
-      InitIterators();
-    }
-    end_of_content_ = scroll_content_.begin() + orig_content_.length();
-    scroll_timeout_ = kBorderWait;
+// Append the byte offset of each codepoint in "str", starting at "start".
+static void IndexCodepoints(const std::string &str,
+                            std::string::size_type start,
+                            std::vector<int> *offsets) {
+  const char *const begin = str.data();
+  const char *const end = begin + str.size();
+  for (const char *it = begin + start; it < end; utf8_next_codepoint(it)) {
+    offsets->push_back(it - begin);
   }
 }
 
-std::string Scroller::GetScrolledContent() {
-  std::string result;
-  result.append(print_start_, print_end_);
-  if (!scrolling_needed_)
-    return result;
+void Scroller::SetValue(const std::string &content, int width) {
+  if (width < 0) width = 0;
+  if (width == width_ && content.size() == orig_content_.size()
+      && content == orig_content_) {
+    return;  // Common case: nothing changed.
+  }
+  orig_content_ = content;
+  width_ = width;
 
-  int char_printed = characters_on_screen_;
-  // Reached end of scroll content. If there is still space, print the beginng
-  // again. We know already that this will never reach end(), so no need to check
-  std::string::iterator print_prefix = scroll_content_.begin();
-  while (char_printed < width_) {
-    ++char_printed;
-    utf8_next_codepoint(print_prefix);
+  scroll_content_ = orig_content_;
+  offsets_.clear();
+  IndexCodepoints(scroll_content_, 0, &offsets_);
+  content_chars_ = offsets_.size();
+  cycle_chars_ = content_chars_;
+  scrolling_needed_ = (content_chars_ > width_);
+  if (scrolling_needed_) {
+    scroll_content_.append(interlude_);
+    IndexCodepoints(scroll_content_, orig_content_.size(), &offsets_);
+    cycle_chars_ = offsets_.size();
+    const std::string::size_type cycle_bytes = scroll_content_.size();
+    scroll_content_.append(orig_content_, 0, offsets_[width_]);
+    IndexCodepoints(scroll_content_, cycle_bytes, &offsets_);
   }
-  result.append(scroll_content_.begin(), print_prefix);
+  offsets_.push_back(scroll_content_.size());
 
-  return result;
+  BuildFrameTable();
+  tick_ = 0;
+  value_changed_ = true;
 }
 
-void Scroller::NextTick() {
-  if (!scrolling_needed_)
+void Scroller::BuildFrameTable() {
+  // A single slice never changes; showing it first is a value change.
+  frames_.clear();
+  if (!scrolling_needed_) {
+    Slice whole = { 0, offsets_[content_chars_], 0, false };
+    frames_.push_back(whole);
     return;
+  }
+
+  if (width_ == 0) {
+    Slice nothing = { 0, 0, 0, false };
+    frames_.push_back(nothing);
+    return;
+  }
 
-  if (scroll_timeout_ > 0) {
-    scroll_timeout_--;
-  } else {
-    utf8_next_codepoint(print_start_);
-    --characters_on_screen_;   // one reduced in front
-    if (print_start_ == scroll_content_.end()) {
-      InitIterators();
-      scroll_timeout_ = kBorderWait;
-    } else if (print_end_ != scroll_content_.end()) {
-      utf8_next_codepoint(print_end_);
-      ++characters_on_screen_; // one added at end.
-      if (print_end_ == end_of_content_) {
-        scroll_timeout_ = kBorderWait;
+  // Simulate one cycle: wait at the beginning, scroll one character per
+  // tick, wait while the end of the content is visible, continue through
+  // the interlude until we're back at the beginning.
+  int position = 0;
+  int timeout = kBorderWait;
+  do {
+    Slice slice = { offsets_[position], offsets_[position + width_],
+                    offsets_[position + width_ - 1], true };
+    if (!frames_.empty()) {
+      slice.changed = (slice.begin != frames_.back().begin);
+    }
+    frames_.push_back(slice);
+
+    if (timeout > 0) {
+      --timeout;
+    } else {
+      ++position;
+      if (position == cycle_chars_) {
+        position = 0;
+        timeout = kBorderWait;
+      } else if (position + width_ == content_chars_) {
+        timeout = kBorderWait;  // End of content is visible.
       }
     }
+  } while (position != 0 || timeout != kBorderWait);
+  frames_[0].changed = (frames_[0].begin != frames_.back().begin);
+}
+
+void Scroller::AppendScrolledContent(LineBuffer *out) const {
+  const Slice &slice = frames_[tick_];
+  const char *const content = scroll_content_.data();
+  out->Append(content + slice.begin, content + slice.end);
+}
+
+void Scroller::NextTick() {
+  value_changed_ = false;
+  if (++tick_ == (int)frames_.size()) {
+    tick_ = 0;
   }
 }
+
+bool Scroller::UpcomingMove(uint32_t *entering) const {
+  // In a scroll cycle, each change is a move by one character.
+  const Slice &slice = frames_[tick_];
+  if (!scrolling_needed_ || width_ == 0 || value_changed_ || !slice.changed)
+    return false;
+  const char *it = scroll_content_.data() + slice.last;
+  *entering = utf8_next_codepoint(it);
+  return true;
+}
@@ -19,9 +19,20 @@
 #ifndef UPNP_DISPLAY_SCROLLER_
 #define UPNP_DISPLAY_SCROLLER_
 
+#include <stdint.h>
+
 #include <string>
+#include <vector>
+
+#include "line-buffer.h"
 
 // Utility class that implements the scrolling logic.
+//
+// The sequence of frames for a given text, width and interlude is fully
+// deterministic. So whenever a new value is set, the whole scroll cycle,
+// including the pauses at the borders, is computed once into a table of
+// slices of the text. Each tick then just advances an index in that table,
+// so the cost per tick is constant no matter how long the text is.
 class Scroller {
 public:
   // Create Scroller that uses given interlude to separate infinit-scroll text.
@@ -30,16 +41,34 @@ public:
   // Set text value to be scrolled and the display width available.
   // If the value or width is different from a previously set value, the scroll
   // position is set to the beginning of the string.
-  void SetValue(std::string &content, int width);
+  void SetValue(const std::string &content, int width);
 
-  // Returns the scrolled content.
-  std::string GetScrolledContent();
+  // Append the currently visible portion of the scrolled content to "out".
+  void AppendScrolledContent(LineBuffer *out) const;
+
+  // Returns 'true' if the visible portion is different from the previous
+  // tick, e.g. 'false' while pausing at the borders.
+  bool FrameChanged() const {
+    return value_changed_ || frames_[tick_].changed;
+  }
 
   // Next time tick to advance position according to internal state.
   void NextTick();
 
+  // Returns 'true' if the frame of the upcoming tick is the current one
+  // moved left by one character. Then "entering" is set to the codepoint
+  // that appears at the right. Used to smoothly scroll in between ticks.
+  bool UpcomingMove(uint32_t *entering) const;
+
 private:
-  void InitIterators();
+  // Visible portion of scroll_content_ in one tick.
+  struct Slice {
+    int begin, end;   // Byte range.
+    int last;         // Byte offset of last visible codepoint.
+    bool changed;     // Different from the previous tick in the cycle.
+  };
+
+  void BuildFrameTable();
 
   const std::string interlude_;
 
@@ -47,14 +76,18 @@ private:
   std::string orig_content_;
   bool scrolling_needed_;         // If text is short, this won't need scrolling.
 
-  std::string scroll_content_;    // scrollable content, including interlude.
+  // Scrollable content: the content, the interlude, and then the first
+  // width_ characters of the content again. That way, each visible window
+  // is a single contiguous slice, even while wrapping around.
+  std::string scroll_content_;
+  std::vector<int> offsets_;      // Byte offset of each codepoint; plus end.
 
-  std::string::const_iterator print_start_;
-  std::string::const_iterator print_end_;
-  std::string::const_iterator end_of_content_;  // before interlude. Wait there.
+  int content_chars_;             // Codepoints in content.
+  int cycle_chars_;               // Codepoints in content + interlude.
 
-  int characters_on_screen_; // portion shown; characters, not bytes.
-  int scroll_timeout_;
+  std::vector<Slice> frames_;     // One full scroll cycle.
+  int tick_;                      // Current index in frames_.
+  bool value_changed_;            // New value since last tick.
 };
 
 #endif  // UPNP_DISPLAY_SCROLLER_
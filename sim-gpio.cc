@@ -0,0 +1,138 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "sim-gpio.h"
+
+#include <time.h>
+
+#include "hd44780-model.h"
+
+SimGPIO::SimGPIO(FILE *waveform)
+  : waveform_(waveform), start_nanos_(0), output_bits_(0), driven_(0),
+    out_(0), recorded_(0) {
+}
+
+SimGPIO::~SimGPIO() {
+  for (size_t i = 0; i < controllers_.size(); ++i) {
+    delete controllers_[i];
+  }
+  if (waveform_) fclose(waveform_);
+}
+
+void SimGPIO::AddController(HD44780Model *model) {
+  controllers_.push_back(model);
+}
+
+int64_t SimGPIO::Now() const {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec - start_nanos_;
+}
+
+bool SimGPIO::Init() {
+  start_nanos_ = Now();
+  return true;
+}
+
+uint32_t SimGPIO::InitOutputs(uint32_t outputs) {
+  if (waveform_ && output_bits_ == 0) {
+    fprintf(waveform_, "$timescale 1ns $end\n$scope module gpio $end\n");
+    for (int b = 0; b < 32; ++b) {
+      if (outputs & (1u << b)) {
+        fprintf(waveform_, "$var wire 1 %c gpio%d $end\n", '!' + b, b);
+      }
+    }
+    fprintf(waveform_, "$upscope $end\n$enddefinitions $end\n");
+    fprintf(waveform_, "#0\n$dumpvars\n");
+    for (int b = 0; b < 32; ++b) {
+      if (outputs & (1u << b)) fprintf(waveform_, "0%c\n", '!' + b);
+    }
+    fprintf(waveform_, "$end\n");
+  }
+  output_bits_ = outputs;
+  driven_ = outputs;
+  OutputsChanged();
+  return output_bits_;
+}
+
+bool SimGPIO::SwitchToInputs(uint32_t bits) {
+  driven_ &= ~(bits & output_bits_);
+  OutputsChanged();
+  return true;
+}
+
+void SimGPIO::SwitchToOutputs(uint32_t bits) {
+  driven_ |= bits & output_bits_;
+  OutputsChanged();
+}
+
+uint32_t SimGPIO::PinLevels(int64_t now, bool sampled) {
+  uint32_t levels = out_ & driven_;
+  for (size_t i = 0; i < controllers_.size(); ++i) {
+    levels |= controllers_[i]->DataOutput(now, sampled) & ~driven_;
+  }
+  return levels;
+}
+
+uint32_t SimGPIO::Read() {
+  const int64_t now = Now();
+  const uint32_t levels = PinLevels(now, true);
+  Record(now, levels);
+  return levels;
+}
+
+void SimGPIO::SetBits(uint32_t value) {
+  out_ |= value & output_bits_;
+  OutputsChanged();
+}
+
+void SimGPIO::ClearBits(uint32_t value) {
+  out_ &= ~(value & output_bits_);
+  OutputsChanged();
+}
+
+void SimGPIO::Write(uint32_t value) {
+  out_ = value & output_bits_;
+  OutputsChanged();
+}
+
+void SimGPIO::busy_nano_sleep(long nanos) {
+  const int64_t until = Now() + nanos;
+  while (Now() < until) {}
+}
+
+void SimGPIO::OutputsChanged() {
+  const int64_t now = Now();
+  for (size_t i = 0; i < controllers_.size(); ++i) {
+    controllers_[i]->Update(now, out_ & driven_, driven_);
+  }
+  Record(now, PinLevels(now, false));
+}
+
+void SimGPIO::Record(int64_t now, uint32_t levels) {
+  if (waveform_ == NULL) return;
+  const uint32_t changed = (levels ^ recorded_) & output_bits_;
+  if (changed == 0) return;
+  fprintf(waveform_, "#%lld\n", (long long)now);
+  for (int b = 0; b < 32; ++b) {
+    if (changed & (1u << b)) {
+      fprintf(waveform_, "%d%c\n", (levels >> b) & 1, '!' + b);
+    }
+  }
+  recorded_ = levels;
+}
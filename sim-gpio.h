@@ -0,0 +1,74 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_SIM_GPIO_
+#define UPNP_DISPLAY_SIM_GPIO_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "gpio.h"
+
+class HD44780Model;
+
+// A GPIO that only exists in software: the pins drive models of the
+// connected display controllers, and the waveform can be recorded with
+// timestamps. Timing is real: busy waiting watches the clock, so that
+// the models see the timing as the program intends it.
+class SimGPIO : public GPIO {
+public:
+  // Record every change of the pins to "waveform" as value change dump
+  // (VCD) file, unless NULL. Takes ownership of the file.
+  explicit SimGPIO(FILE *waveform);
+  virtual ~SimGPIO();
+
+  // Connect a controller. Takes ownership.
+  void AddController(HD44780Model *model);
+
+  virtual bool Init();
+  virtual uint32_t InitOutputs(uint32_t outputs);
+  virtual bool SwitchToInputs(uint32_t bits);
+  virtual void SwitchToOutputs(uint32_t bits);
+  virtual uint32_t Read();
+  virtual void SetBits(uint32_t value);
+  virtual void ClearBits(uint32_t value);
+  virtual void Write(uint32_t value);
+  virtual void busy_nano_sleep(long nanos);
+  virtual void RecalibrateIfDue() {}  // Waiting watches the clock.
+
+private:
+  int64_t Now() const;
+
+  // Pins that are not driven by us get what the controllers drive.
+  uint32_t PinLevels(int64_t now, bool sampled);
+
+  // Tell the controllers about the new state of our outputs and record it.
+  void OutputsChanged();
+  void Record(int64_t now, uint32_t levels);
+
+  FILE *const waveform_;
+  std::vector<HD44780Model*> controllers_;
+  int64_t start_nanos_;
+  uint32_t output_bits_;   // Pins initialized as outputs.
+  uint32_t driven_;        // Outputs not temporarily switched to input.
+  uint32_t out_;           // Levels we output.
+  uint32_t recorded_;      // Last levels written to the waveform.
+};
+
+#endif  // UPNP_DISPLAY_SIM_GPIO_
@@ -0,0 +1,167 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// The display update must not allocate memory in steady state: on our
+// small ARM boards, allocator churn shows as jitter in the realtime
+// process. This test counts all allocations and checks that none happen
+// in ticks, once each situation had a few ticks to warm up.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
+
+#include "clock.h"
+#include "recording-printer.h"
+#include "renderer-events.h"
+#include "renderer-state.h"
+#include "upnp-display.h"
+
+static long allocations = 0;
+
+void *operator new(size_t size) throw (std::bad_alloc) {
+  ++allocations;
+  void *result = malloc(size ? size : 1);
+  if (result == NULL) throw std::bad_alloc();
+  return result;
+}
+void *operator new[](size_t size) throw (std::bad_alloc) {
+  return operator new(size);
+}
+void operator delete(void *p) throw() { free(p); }
+void operator delete[](void *p) throw() { free(p); }
+
+static const int kTickMillis = 400;       // As in UPnPDisplay::Loop().
+static const int kSmoothScrollSteps = 5;
+static const int kWarmupTicks = 100;
+static const int kMeasuredTicks = 2000;
+
+// Like an LCD: only ASCII, so other text is transliterated, and shows
+// smooth scrolling.
+class AsciiPrinter : public RecordingPrinter {
+public:
+  AsciiPrinter(int width, int height) : RecordingPrinter(width, height) {}
+  virtual bool supports_pixel_shift() const { return true; }
+  virtual bool CanShow(Frame::Codepoint cp) const { return cp < 0x80; }
+};
+
+static int position_polls = 0;
+
+// Play the controller's poll thread, in between ticks: poll "renderer" if
+// due, and answer as a renderer playing since clock time 0 would. This may
+// allocate; it is not part of the tick.
+static void PollPosition(VirtualClock *clock, RendererState *renderer) {
+  if (renderer == NULL || !renderer->PollPositionIfDue())
+    return;
+  ++position_polls;
+  // Without network, the poll failed right away; this is the answer.
+  SendPositionInfo(renderer, clock->NowMillis() / 1000 % 3600, 3600);
+}
+
+// Run ticks as UPnPDisplay::Loop() does, with position polls of "renderer"
+// (can be NULL) in between. Returns number of ticks that allocated.
+static int RunTicks(const char *situation, int count, VirtualClock *clock,
+                    UPnPDisplay *display, RendererState *renderer) {
+  for (int i = 0; i < kWarmupTicks; ++i) {
+    for (int step = 0; step < kSmoothScrollSteps; ++step) {
+      clock->SleepMillis(kTickMillis / kSmoothScrollSteps);
+      if (step == 0) display->Tick(); else display->SubTick(step);
+    }
+    PollPosition(clock, renderer);
+  }
+  int failed_ticks = 0;
+  long total = 0;
+  for (int i = 0; i < count; ++i) {
+    const long before = allocations;
+    for (int step = 0; step < kSmoothScrollSteps; ++step) {
+      clock->SleepMillis(kTickMillis / kSmoothScrollSteps);
+      if (step == 0) display->Tick(); else display->SubTick(step);
+    }
+    if (allocations != before) {
+      ++failed_ticks;
+      total += allocations - before;
+    }
+    PollPosition(clock, renderer);
+  }
+  printf("%-28s %d ticks, %d allocated (%ld allocations)\n",
+         situation, count, failed_ticks, total);
+  return failed_ticks;
+}
+
+int main() {
+  VirtualClock clock;
+  // Failing actions are logged; that is expected without network.
+  FILE *renderer_log = fopen("/dev/null", "w");
+  RendererState state("uuid:alloc-test", &clock, renderer_log);
+  // With control URLs, the renderer could poll its position. The display
+  // update must leave that to the controller's poll thread.
+  RendererState::SubscriptionMap subscriptions;
+  SendDescription(&state, &subscriptions);
+  AsciiPrinter printer(20, 4);
+  UPnPDisplay display("", &printer, &clock, 0, stderr);
+  display.set_smooth_scroll(true);
+  std::string error;
+  if (!display.SetLayout(3, "{state} {time} {progress} {remaining}",
+                         &error)) {
+    fprintf(stderr, "Layout: %s\n", error.c_str());
+    return 1;
+  }
+
+  int failed = RunTicks("Waiting for renderer", kMeasuredTicks,
+                        &clock, &display, NULL);
+  display.AddRenderer("uuid:alloc-test", &state);
+
+  // Long enough to scroll, and with characters to transliterate.
+  SendTrackEvent(&state, 1,
+                 "\xd0\x96\xd0\xb8\xd0\xb7\xd0\xbd\xd1\x8c \xe2\x80\x94 "
+                 "\xe2\x80\x9cThe Long Title of a Song\xe2\x80\x9d",
+                 "Stra\xc3\x9f" "enmusikanten", 3600);
+  SendPositionInfo(&state, 0, 3600);
+  SendEvent(&state, "<Volume val=\"30\"/>");
+  failed += RunTicks("Playing, scrolling", kMeasuredTicks,
+                     &clock, &display, &state);
+
+  SendEvent(&state, "<Volume val=\"35\"/>");
+  failed += RunTicks("Volume change", kMeasuredTicks,
+                     &clock, &display, &state);
+
+  SendEvent(&state, "<TransportState val=\"PAUSED_PLAYBACK\"/>");
+  failed += RunTicks("Paused, blinking", kMeasuredTicks,
+                     &clock, &display, &state);
+
+  SendEvent(&state, "<Mute val=\"1\"/>");
+  failed += RunTicks("Muted", kMeasuredTicks,
+                     &clock, &display, &state);
+
+  SendEvent(&state, "<Mute val=\"0\"/><TransportState val=\"STOPPED\"/>");
+  failed += RunTicks("Stopped", kMeasuredTicks,
+                     &clock, &display, &state);
+
+  fclose(renderer_log);
+  printf("%d position polls\n", position_polls);
+  if (failed > 0) {
+    printf("FAIL: %d ticks allocated memory\n", failed);
+    return 1;
+  }
+  if (position_polls == 0) {
+    printf("FAIL: renderer never polled its position\n");
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
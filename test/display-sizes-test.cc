@@ -0,0 +1,79 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Runs the display through waiting, playing and goodbye on every display
+// height, with the default layouts, and checks the first and last row.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "clock.h"
+#include "frame.h"
+#include "line-buffer.h"
+#include "recording-printer.h"
+#include "renderer-events.h"
+#include "renderer-state.h"
+#include "upnp-display.h"
+
+static int failures = 0;
+
+static void Expect(int height, const char *what, const RecordingPrinter &p,
+                   int row, const char *expected) {
+  LineBuffer text;
+  p.GetText(row, &text);
+  if (strcmp(text.data(), expected) != 0) {
+    fprintf(stderr, "%d lines, %s: row %d is '%s', expected '%s'\n",
+            height, what, row, text.data(), expected);
+    ++failures;
+  }
+}
+
+int main() {
+  for (int height = 1; height <= Frame::kMaxHeight; ++height) {
+    VirtualClock clock;
+    RendererState state("uuid:sizes", &clock, stderr);
+    RecordingPrinter printer(24, height);
+    UPnPDisplay display("", &printer, &clock, 0, stderr);
+
+    display.Tick();
+    Expect(height, "waiting", printer, 0,
+           height > 1 ? "Waiting for" : "Waiting for any Renderer");
+    if (height > 1)
+      Expect(height, "waiting", printer, 1, "any Renderer");
+
+    display.AddRenderer("uuid:sizes", &state);
+    SendTrackEvent(&state, 1, "Title", "Artist", 200);
+    SendPositionInfo(&state, 62, 200);
+    display.Tick();
+    Expect(height, "playing", printer, 0, "Title");
+    if (height > 1) {
+      Expect(height, "playing", printer, height - 1,
+             height == 2 ? "1:02              Artist" : "1:02");
+    }
+
+    display.ShowGoodbye();
+    Expect(height, "goodbye", printer, 0, "Goodbye!");
+  }
+
+  if (failures > 0) {
+    printf("FAIL: %d checks\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,134 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Benchmark of the glyph lookup (make font-bench): looks up every glyph
+// of the font, as FontHasGlyph() and FontGetGlyph() do it, and as a
+// bsearch() over a sorted array of codepoint and rows, which is how the
+// font was stored before the page index. Also checks that both find the
+// same glyphs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "font.h"
+
+static const int kRounds = 2000;
+
+// One glyph of the sorted table.
+struct Glyph {
+  uint32_t codepoint;
+  uint8_t rows[8];
+};
+
+static int CompareGlyph(const void *a, const void *b) {
+  const uint32_t ca = ((const Glyph*) a)->codepoint;
+  const uint32_t cb = ((const Glyph*) b)->codepoint;
+  return (ca < cb) ? -1 : (ca > cb);
+}
+
+static std::vector<Glyph> table;
+
+static const Glyph *BsearchGlyph(uint32_t codepoint) {
+  Glyph key;
+  key.codepoint = codepoint;
+  return (const Glyph*) bsearch(&key, &table[0], table.size(),
+                                sizeof(Glyph), CompareGlyph);
+}
+
+static double CpuSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Report(const char *what, double seconds, unsigned checksum) {
+  printf("%-28s %6.1f ns/lookup  (checksum %u)\n", what,
+         seconds * 1e9 / ((double) kRounds * table.size()), checksum);
+}
+
+int main() {
+  std::vector<uint32_t> codepoints;
+  for (uint32_t cp = 0; cp < 0x10000; ++cp) {
+    Glyph glyph;
+    glyph.codepoint = cp;
+    if (!FontGetGlyph(cp, glyph.rows)) continue;
+    table.push_back(glyph);
+    codepoints.push_back(cp);
+  }
+  printf("%d glyphs, %d rounds\n", (int) table.size(), kRounds);
+
+  // Both must agree on all codepoints, including those without a glyph.
+  int mismatches = 0;
+  for (uint32_t cp = 0; cp < 0x11000; ++cp) {
+    uint8_t rows[8];
+    const bool found = FontGetGlyph(cp, rows);
+    const Glyph *glyph = BsearchGlyph(cp);
+    if (found != FontHasGlyph(cp) || found != (glyph != NULL)
+        || (found && memcmp(rows, glyph->rows, 8) != 0)) {
+      ++mismatches;
+    }
+  }
+
+  unsigned checksum = 0;
+  double start = CpuSeconds();
+  for (int r = 0; r < kRounds; ++r) {
+    for (size_t i = 0; i < codepoints.size(); ++i)
+      checksum += (BsearchGlyph(codepoints[i]) != NULL);
+  }
+  Report("bsearch()", CpuSeconds() - start, checksum);
+
+  checksum = 0;
+  start = CpuSeconds();
+  for (int r = 0; r < kRounds; ++r) {
+    for (size_t i = 0; i < codepoints.size(); ++i)
+      checksum += FontHasGlyph(codepoints[i]);
+  }
+  Report("FontHasGlyph()", CpuSeconds() - start, checksum);
+
+  checksum = 0;
+  start = CpuSeconds();
+  for (int r = 0; r < kRounds; ++r) {
+    for (size_t i = 0; i < codepoints.size(); ++i) {
+      uint8_t rows[8];
+      memcpy(rows, BsearchGlyph(codepoints[i])->rows, 8);
+      checksum += rows[i % 8];
+    }
+  }
+  Report("bsearch() and copy rows", CpuSeconds() - start, checksum);
+
+  checksum = 0;
+  start = CpuSeconds();
+  for (int r = 0; r < kRounds; ++r) {
+    for (size_t i = 0; i < codepoints.size(); ++i) {
+      uint8_t rows[8];
+      FontGetGlyph(codepoints[i], rows);
+      checksum += rows[i % 8];
+    }
+  }
+  Report("FontGetGlyph()", CpuSeconds() - start, checksum);
+
+  if (mismatches > 0) {
+    printf("FAIL: lookups differ for %d codepoints\n", mismatches);
+    return 1;
+  }
+  return 0;
+}
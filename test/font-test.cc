@@ -0,0 +1,152 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Checks the glyph lookup through the page index: the built-in font, the
+// same font loaded from a file (font/5x8.font, built by make), and that
+// damaged font files are rejected without changing the font in use.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "font.h"
+
+static const char kFontFile[] = "font/5x8.font";
+
+static int failures = 0;
+
+// Rows of all glyphs below U+11000, empty where there is none. Returns
+// number of glyphs; counts codepoints where FontHasGlyph() disagrees.
+static int GetAllGlyphs(std::vector<uint8_t> *rows) {
+  rows->assign(0x11000 * 8, 0);
+  int glyphs = 0;
+  for (uint32_t cp = 0; cp < 0x11000; ++cp) {
+    const bool found = FontGetGlyph(cp, &(*rows)[8 * cp]);
+    if (found != FontHasGlyph(cp)) {
+      fprintf(stderr, "U+%04X: FontHasGlyph() disagrees\n", cp);
+      ++failures;
+    }
+    if (found) ++glyphs;
+  }
+  return glyphs;
+}
+
+// Write "content" to a temporary file and check that loading it fails
+// with "expected_error".
+static void ExpectRejected(const std::string &content, const char *what,
+                           const char *expected_error) {
+  char filename[] = "/tmp/font-test-XXXXXX";
+  const int fd = mkstemp(filename);
+  if (fd < 0 || write(fd, content.data(), content.size())
+      != (ssize_t)content.size()) {
+    perror("temporary file");
+    ++failures;
+    return;
+  }
+  close(fd);
+  std::string error;
+  if (FontLoadFile(filename, &error)) {
+    fprintf(stderr, "%s: loaded\n", what);
+    ++failures;
+  } else if (error != expected_error) {
+    fprintf(stderr, "%s: '%s', expected '%s'\n", what, error.c_str(),
+            expected_error);
+    ++failures;
+  }
+  unlink(filename);
+}
+
+int main() {
+  std::vector<uint8_t> builtin;
+  const int glyphs = GetAllGlyphs(&builtin);
+  printf("%d glyphs built in\n", glyphs);
+
+  // A few glyphs we know; 'A' as in font/5x8.bdf.
+  static const uint8_t kA[8] = { 0x00, 0x0c, 0x12, 0x12, 0x1e, 0x12, 0x12,
+                                 0x00 };
+  if (memcmp(&builtin[8 * 'A'], kA, 8) != 0) {
+    fprintf(stderr, "'A' looks wrong\n");
+    ++failures;
+  }
+  if (!FontHasGlyph(0xe9) || !FontHasGlyph(0x3b1) || FontHasGlyph(0x4e00)
+      || FontHasGlyph(0x10000)) {
+    fprintf(stderr, "Wrong glyphs for U+00E9, U+03B1, U+4E00, U+10000\n");
+    ++failures;
+  }
+
+  FILE *f = fopen(kFontFile, "rb");
+  if (f == NULL) {
+    perror(kFontFile);
+    return 1;
+  }
+  std::string content;
+  char buffer[4096];
+  size_t r;
+  while ((r = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    content.append(buffer, r);
+  }
+  fclose(f);
+
+  // Damaged files; after each, the built-in font must still be in use.
+  const int pages = (unsigned char) content[10]
+    | ((unsigned char) content[11] << 8);
+  std::string damaged = content;
+  damaged[8] = 1;                      // Version 1 had no rank table.
+  ExpectRejected(damaged, "version 1", "Not a font file");
+  damaged = content.substr(0, content.size() - 1);
+  ExpectRejected(damaged, "truncated", "Font file is corrupt");
+  damaged = content;
+  damaged[16 + 8 * pages + 3] += 1;    // Rank of a byte of the first page.
+  ExpectRejected(damaged, "rank table", "Font file is corrupt");
+  damaged = content;
+  damaged[16 + 18 * pages] = pages + 1;  // Index beyond the pages.
+  ExpectRejected(damaged, "page index", "Font file is corrupt");
+
+  std::vector<uint8_t> after;
+  GetAllGlyphs(&after);
+  if (after != builtin) {
+    fprintf(stderr, "Font changed by files that failed to load\n");
+    ++failures;
+  }
+
+  // The file has the same glyphs as the built-in font.
+  std::string error;
+  if (!FontLoadFile(kFontFile, &error)) {
+    fprintf(stderr, "%s: %s\n", kFontFile, error.c_str());
+    return 1;
+  }
+  std::vector<uint8_t> from_file;
+  const int file_glyphs = GetAllGlyphs(&from_file);
+  printf("%d glyphs in %s (%d bytes, %d pages)\n", file_glyphs, kFontFile,
+         (int)content.size(), pages);
+  if (from_file != builtin) {
+    fprintf(stderr, "%s differs from the built-in font\n", kFontFile);
+    ++failures;
+  }
+
+  if (failures > 0) {
+    printf("FAIL: %d checks\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,287 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Checks GpiochipGPIO against a simulated kernel: how our bits map to the
+// requested lines, switching lines to inputs and back, and that LCD
+// nibbles arrive intact with as few system calls as possible.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "frame.h"
+#include "gpiochip-gpio.h"
+#include "hd44780-model.h"
+#include "lcd-display.h"
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+
+static int failures = 0;
+
+#define EXPECT_EQ(expected, actual)                                     \
+  do {                                                                  \
+    const unsigned long long e = (expected), a = (actual);              \
+    if (e != a) {                                                       \
+      fprintf(stderr, "%s:%d: %s is 0x%llx, expected 0x%llx\n",         \
+              __FILE__, __LINE__, #actual, a, e);                       \
+      ++failures;                                                       \
+    }                                                                   \
+  } while (0)
+
+// Plays the kernel side of a gpiochip. Line levels are kept per requested
+// line, as the kernel sees them.
+class SimulatedChip : public GpiochipGPIO {
+public:
+  SimulatedChip()
+    : GpiochipGPIO("/dev/null"), fail_config(false), set_calls(0),
+      config_calls(0), levels(0), input_levels(0) {
+    memset(&request, 0, sizeof(request));
+    memset(&config, 0, sizeof(config));
+    memset(&set, 0, sizeof(set));
+  }
+
+  struct gpio_v2_line_request request;  // Last request of lines.
+  struct gpio_v2_line_config config;    // Last configuration.
+  struct gpio_v2_line_values set;       // Last values set.
+  bool fail_config;
+  int set_calls;
+  int config_calls;
+  uint64_t levels;                      // Output levels.
+  uint64_t input_levels;                // What reading returns.
+
+protected:
+  virtual int Ioctl(int, unsigned long request_code, void *arg) {
+    if (request_code == GPIO_V2_GET_LINE_IOCTL) {
+      request = *static_cast<struct gpio_v2_line_request*>(arg);
+      static_cast<struct gpio_v2_line_request*>(arg)->fd
+        = open("/dev/null", O_RDONLY);
+      return 0;
+    }
+    if (request_code == GPIO_V2_LINE_SET_CONFIG_IOCTL) {
+      ++config_calls;
+      if (fail_config) {
+        errno = EIO;
+        return -1;
+      }
+      config = *static_cast<struct gpio_v2_line_config*>(arg);
+      return 0;
+    }
+    if (request_code == GPIO_V2_LINE_SET_VALUES_IOCTL) {
+      ++set_calls;
+      set = *static_cast<struct gpio_v2_line_values*>(arg);
+      levels = (levels & ~set.mask) | (set.bits & set.mask);
+      Changed();
+      return 0;
+    }
+    if (request_code == GPIO_V2_LINE_GET_VALUES_IOCTL) {
+      struct gpio_v2_line_values *values
+        = static_cast<struct gpio_v2_line_values*>(arg);
+      values->bits = input_levels & values->mask;
+      return 0;
+    }
+    return -1;
+  }
+
+  virtual void Changed() {}
+};
+
+// Receives nibbles like an LCD controller: latched on the falling edge of
+// the enable line. Counts changes of other lines at the same time as an
+// enable edge, which would violate setup or hold times.
+class NibbleChip : public SimulatedChip {
+public:
+  NibbleChip() : edge_violations(0), previous_(0) {}
+
+  std::vector<int> nibbles;   // RS in bit 4.
+  int edge_violations;
+
+  uint64_t Line(uint32_t bit) const {
+    for (unsigned int i = 0; i < request.num_lines; ++i) {
+      if (bit == (1u << request.offsets[i])) return 1ULL << i;
+    }
+    return 0;
+  }
+
+protected:
+  virtual void Changed() {
+    const HD44780Model::Wiring wiring = LCDDisplay::wiring(0);
+    const uint64_t enable = Line(wiring.enable);
+    const uint64_t changed = previous_ ^ levels;
+    if ((changed & enable) && (changed & ~enable))
+      ++edge_violations;
+    if ((previous_ & enable) && !(levels & enable)) {
+      int nibble = (levels & Line(wiring.rs)) ? 0x10 : 0;
+      for (int i = 0; i < 4; ++i) {
+        if (levels & Line(wiring.data[i])) nibble |= 1 << i;
+      }
+      nibbles.push_back(nibble);
+    }
+    previous_ = levels;
+  }
+
+private:
+  uint64_t previous_;
+};
+
+static void TestLineMapping() {
+  SimulatedChip chip;
+  chip.Init();
+  const uint32_t outputs = (1 << 7) | (1 << 8) | (1 << 14) | (1 << 18)
+    | (1 << 23);
+  EXPECT_EQ(outputs, chip.InitOutputs(outputs));
+  EXPECT_EQ(5, chip.request.num_lines);
+  EXPECT_EQ(7, chip.request.offsets[0]);
+  EXPECT_EQ(8, chip.request.offsets[1]);
+  EXPECT_EQ(14, chip.request.offsets[2]);
+  EXPECT_EQ(18, chip.request.offsets[3]);
+  EXPECT_EQ(23, chip.request.offsets[4]);
+  EXPECT_EQ(GPIO_V2_LINE_FLAG_OUTPUT, chip.request.config.flags);
+
+  chip.SetBits((1 << 14) | (1 << 23));
+  EXPECT_EQ(1, chip.set_calls);
+  EXPECT_EQ(0x14, chip.set.mask);
+  EXPECT_EQ(0x14, chip.set.bits);
+
+  chip.SetBits(1 << 14);            // Already set: no system call.
+  chip.SetBits(1 << 30);            // Not requested.
+  chip.ClearBits(1 << 7);           // Already clear.
+  EXPECT_EQ(1, chip.set_calls);
+
+  chip.Write((1 << 8) | (1 << 30));
+  EXPECT_EQ(2, chip.set_calls);
+  EXPECT_EQ(0x1f, chip.set.mask);
+  EXPECT_EQ(0x02, chip.set.bits);
+
+  chip.input_levels = 0x11;
+  EXPECT_EQ((1u << 7) | (1u << 23), chip.Read());
+}
+
+static void TestSwitchToInputs() {
+  SimulatedChip chip;
+  chip.Init();
+  const uint32_t outputs = (1 << 7) | (1 << 8) | (1 << 14) | (1 << 18)
+    | (1 << 23);
+  chip.InitOutputs(outputs);
+  chip.Write(1 << 14);
+
+  // The others keep their level while lines 0 and 1 are inputs.
+  EXPECT_EQ(true, chip.SwitchToInputs((1 << 7) | (1 << 8)));
+  EXPECT_EQ(1, chip.config_calls);
+  EXPECT_EQ(2, chip.config.num_attrs);
+  EXPECT_EQ(GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES, chip.config.attrs[0].attr.id);
+  EXPECT_EQ(0x1c, chip.config.attrs[0].mask);
+  EXPECT_EQ(0x04, chip.config.attrs[0].attr.values);
+  EXPECT_EQ(GPIO_V2_LINE_ATTR_ID_FLAGS, chip.config.attrs[1].attr.id);
+  EXPECT_EQ(GPIO_V2_LINE_FLAG_INPUT, chip.config.attrs[1].attr.flags);
+  EXPECT_EQ(0x03, chip.config.attrs[1].mask);
+
+  const int set_calls = chip.set_calls;
+  chip.SetBits(1 << 7);             // Input: not set.
+  EXPECT_EQ(set_calls, chip.set_calls);
+  EXPECT_EQ(true, chip.SwitchToInputs(1 << 7));  // Already input.
+  EXPECT_EQ(1, chip.config_calls);
+
+  chip.SwitchToOutputs((1 << 7) | (1 << 8));
+  EXPECT_EQ(2, chip.config_calls);
+  EXPECT_EQ(1, chip.config.num_attrs);
+  EXPECT_EQ(0x1f, chip.config.attrs[0].mask);
+  EXPECT_EQ(0x04, chip.config.attrs[0].attr.values);
+
+  // If the kernel refuses, the lines stay outputs and can be set.
+  chip.fail_config = true;
+  EXPECT_EQ(false, chip.SwitchToInputs(1 << 7));
+  chip.SetBits(1 << 7);
+  EXPECT_EQ(set_calls + 1, chip.set_calls);
+}
+
+// Send all nibbles as LCDDisplay does; check that they arrive and count
+// the system calls.
+static void TestNibbles() {
+  const HD44780Model::Wiring wiring = LCDDisplay::wiring(0);
+  NibbleChip chip;
+  chip.Init();
+  chip.InitOutputs(wiring.enable | wiring.rs | wiring.data[0]
+                   | wiring.data[1] | wiring.data[2] | wiring.data[3]);
+  std::vector<int> sent;
+  for (int i = 0; i < 64; ++i) {
+    const int nibble = (i * 7) & 0x1f;   // Every value, in mixed order.
+    uint32_t out = (nibble & 0x10) ? wiring.rs : 0;
+    for (int b = 0; b < 4; ++b) {
+      if (nibble & (1 << b)) out |= wiring.data[b];
+    }
+    chip.Write(out);
+    chip.SetBits(wiring.enable);
+    chip.ClearBits(wiring.enable);
+    sent.push_back(nibble);
+  }
+  EXPECT_EQ(sent.size(), chip.nibbles.size());
+  EXPECT_EQ(true, sent == chip.nibbles);
+  EXPECT_EQ(0, chip.edge_violations);
+  printf("%d nibbles with %d system calls\n",
+         (int)sent.size(), chip.set_calls);
+}
+
+// System calls for the LCD to show a line of text.
+static void TestLCDText() {
+  SimulatedChip *chip = new SimulatedChip();
+  LCDDisplay lcd(chip, 16, 2);
+  if (!lcd.Init()) {
+    fprintf(stderr, "LCD init failed\n");
+    ++failures;
+    return;
+  }
+  const int before = chip->set_calls;
+  lcd.Print(0, "Sixteen chars!!!");
+  lcd.Print(1, "0123456789abcdef");
+  // 32 characters and 2 set address commands, 2 nibbles each.
+  const int nibbles = 2 * (32 + 2);
+  printf("LCD: %d nibbles with %d system calls (%.2f per nibble)\n",
+         nibbles, chip->set_calls - before,
+         (double)(chip->set_calls - before) / nibbles);
+  if (chip->set_calls - before > 3 * nibbles) {
+    fprintf(stderr, "More than 3 system calls per nibble\n");
+    ++failures;
+  }
+}
+
+int main() {
+  TestLineMapping();
+  TestSwitchToInputs();
+  TestNibbles();
+  TestLCDText();
+  if (failures > 0) {
+    printf("FAIL: %d checks\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
+
+#else  // Kernel headers without the version 2 interface.
+
+int main() {
+  printf("PASS (GPIO character device not supported by these headers)\n");
+  return 0;
+}
+
+#endif
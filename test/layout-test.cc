@@ -0,0 +1,74 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Compiles layout templates and checks how they render.
+
+#include <stdio.h>
+
+#include <string>
+
+#include "layout.h"
+
+static int failures = 0;
+
+// Render "layout_template" 20 wide; expect "head|body", or "error" if it
+// should not compile.
+static void Expect(const char *layout_template, const std::string *fields,
+                   const char *expected) {
+  LineLayout layout;
+  std::string error, head, body, result;
+  if (layout.Compile(layout_template, &error)) {
+    layout.Render(fields, 20, &head, &body);
+    result = head + "|" + body;
+  } else {
+    result = "error";
+  }
+  if (result != expected) {
+    fprintf(stderr, "'%s' gives '%s', expected '%s' (%s)\n", layout_template,
+            result.c_str(), expected, error.c_str());
+    ++failures;
+  }
+}
+
+int main() {
+  std::string fields[NUM_LAYOUT_FIELDS];
+  fields[FIELD_TITLE] = "Song";
+  fields[FIELD_ARTIST] = "Band";
+  fields[FIELD_ALBUM] = "Record";
+  fields[FIELD_TIME] = "1:23";
+
+  Expect("{title}", fields, "|Song");
+  Expect("{composer: }{title}", fields, "|Song");
+  Expect("{title} {by artist}", fields, "|Song by Band");
+  Expect("{at time}", fields, "|at 1:23");
+  Expect("{by composer}", fields, "|");
+  Expect("{from album/artist.}", fields, "|from Record/Band.");
+  Expect("{time} {album|artist>}", fields, "1:23 |Record");
+  Expect("{on a record album<}", fields, "|on a record Record");
+  Expect("{titel}", fields, "error");
+  Expect("{by titel}", fields, "error");
+  Expect("{: }", fields, "error");
+  Expect("{title", fields, "error");
+
+  if (failures > 0) {
+    printf("FAIL: %d layouts\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,346 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Drives two LCDDisplays at the same time, each on a SimGPIO with models
+// of its controllers, and checks after every frame that what the
+// controllers have in DDRAM and CGRAM shows the frame, and that the bus
+// timing was met. A 16x2 display reads the busy flag, a 40x4 display
+// with two controllers uses fixed delays. The 16x2 display records its
+// waveform. Also checks that the model flags the nibble timing the
+// driver used to have.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "font.h"
+#include "frame.h"
+#include "hd44780-model.h"
+#include "lcd-display.h"
+#include "line-buffer.h"
+#include "sim-gpio.h"
+
+struct TestDisplay {
+  const char *name;
+  int width;
+  int height;
+  LCDDisplay *lcd;
+  HD44780Model *controller[2];  // Second only used on large displays.
+};
+
+static void CreateDisplay(TestDisplay *display, FILE *waveform) {
+  SimGPIO *gpio = new SimGPIO(waveform);
+  for (int i = 0; i < 2; ++i) {
+    display->controller[i] = new HD44780Model(display->name,
+                                              LCDDisplay::wiring(i), stderr);
+    gpio->AddController(display->controller[i]);
+  }
+  display->lcd = new LCDDisplay(gpio, display->width, display->height);
+}
+
+// Pixel rows of a cell showing "cp", as the user should see it.
+static void ExpectedGlyph(Frame::Codepoint cp, uint8_t rows[8]) {
+  if (cp >= Frame::kProgressBar
+      && cp <= Frame::kProgressBar + Frame::kProgressBarSteps) {
+    const int fill = cp - Frame::kProgressBar;
+    memset(rows, (0x1f << (5 - fill)) & 0x1f, 8);
+    return;
+  }
+  if (!FontGetGlyph(cp, rows)) FontGetGlyph('?', rows);
+}
+
+// Pixel rows shown for character "c" in DDRAM. Our font stands in for
+// the ASCII ROM.
+static bool ShownGlyph(const HD44780Model *controller, uint8_t c,
+                       uint8_t rows[8]) {
+  if (c < 16) {
+    memcpy(rows, controller->cgram() + 8 * (c & 7), 8);
+    return true;
+  }
+  if (c == 0xff) {
+    memset(rows, 0x1f, 8);
+    return true;
+  }
+  return c < 0x80 && FontGetGlyph(c, rows);
+}
+
+// Returns number of cells that don't show what the frame has.
+static int CheckPanel(const TestDisplay &display, const Frame &frame) {
+  static int reported = 0;
+  const bool dual_controller = display.width * display.height > 80;
+  int errors = 0;
+  for (int row = 0; row < display.height; ++row) {
+    const HD44780Model *controller
+      = display.controller[(row >= 2 && dual_controller) ? 1 : 0];
+    int address = (row % 2) ? 0x40 : 0x00;
+    if (row >= 2 && !dual_controller) address += display.width;
+    const Frame::PixelShift &shift = frame.pixel_shift(row);
+    for (int col = 0; col < display.width; ++col) {
+      uint8_t want[8];
+      ExpectedGlyph(frame.at(row, col), want);
+      if (shift.pixels > 0 && col >= shift.begin && col < shift.end) {
+        uint8_t right[8];
+        ExpectedGlyph(col + 1 < shift.end ? frame.at(row, col + 1)
+                      : shift.entering, right);
+        for (int i = 0; i < 8; ++i) {
+          want[i] = ((want[i] << shift.pixels)
+                     | (right[i] >> (5 - shift.pixels))) & 0x1f;
+        }
+      }
+      const uint8_t c = controller->ddram()[address + col];
+      uint8_t shown[8];
+      if (!ShownGlyph(controller, c, shown) || memcmp(shown, want, 8) != 0) {
+        if (reported++ < 10) {
+          fprintf(stderr, "%s: cell %d,%d shows character 0x%02x, "
+                  "expected U+%04X\n", display.name, row, col, c,
+                  frame.at(row, col));
+        }
+        ++errors;
+      }
+    }
+  }
+  return errors;
+}
+
+static void SetText(Frame *frame, int row, const char *utf8) {
+  if (row < frame->height()) frame->SetLine(row, LineBuffer(utf8));
+}
+
+static int ShowAndCheck(TestDisplay *display, const Frame &frame) {
+  display->lcd->SubmitFrame(frame);
+  return CheckPanel(*display, frame);
+}
+
+// The frames we show, on both displays in turn.
+static int RunFrames(TestDisplay *displays, int count) {
+  int errors = 0;
+  for (int d = 0; d < count; ++d) {
+    TestDisplay *display = &displays[d];
+    Frame frame(display->width, display->height);
+    SetText(&frame, 0, "Hello, World");
+    SetText(&frame, 1, "Tick tock");
+    SetText(&frame, 2, "Third line");
+    SetText(&frame, 3, "Fourth line");
+    errors += ShowAndCheck(display, frame);
+
+    // Eight custom characters, as many as fit.
+    SetText(&frame, 0, "Gr\xc3\xbc\xc3\x9f" "e aus K\xc3\xb6ln");
+    SetText(&frame, 1, "\xce\x95\xce\xbb\xce\xbb\xce\xac\xce\xb4\xce\xb1");
+    errors += ShowAndCheck(display, frame);
+
+    // Smooth scrolling part of a line.
+    SetText(&frame, 0, "Scroll me");
+    SetText(&frame, 1, "Tick tock");
+    for (int pixels = 1; pixels < 5; ++pixels) {
+      frame.SetPixelShift(0, 0, 4, pixels, 'l');
+      errors += ShowAndCheck(display, frame);
+    }
+    frame.ClearPixelShifts();
+
+    // Progress bar growing over the last line, next to other glyphs.
+    SetText(&frame, 0, "Caf\xc3\xa9 \xc2\xb5s");
+    const int last = display->height - 1;
+    for (int pos = 0; pos <= display->width * 5; pos += 3) {
+      for (int col = 0; col < display->width; ++col) {
+        int fill = pos - 5 * col;
+        fill = fill < 0 ? 0 : (fill > 5 ? 5 : fill);
+        frame.set(last, col, Frame::kProgressBar + fill);
+      }
+      errors += ShowAndCheck(display, frame);
+    }
+
+    // More glyphs than fit: the partial fills of the bar keep their 4
+    // slots, text gets the other 4 in reading order; the rest shows '?',
+    // no matter what was shown before.
+    static const char kGreek[] = "\xce\xb1\xce\xb2\xce\xb3\xce\xb4"
+      "\xce\xb5\xce\xb6\xce\xb7\xce\xb8\xce\xb9";
+    SetText(&frame, 0, kGreek);
+    for (int col = 0; col < display->width; ++col) {
+      frame.set(last, col, Frame::kProgressBar + (col < 3 ? 5 : 0));
+    }
+    frame.set(last, 3, Frame::kProgressBar + 2);
+    Frame expected = frame;
+    for (int col = 4; col < 9; ++col) {
+      expected.set(0, col, '?');
+    }
+    display->lcd->SubmitFrame(frame);
+    errors += CheckPanel(*display, expected);
+
+    // The growing bar and changing text don't make glyphs thrash: each
+    // of these frames writes one cell, and no glyph.
+    for (int fill = 3; fill <= 5; ++fill) {
+      frame.set(last, 3, Frame::kProgressBar + fill);
+      expected.set(last, 3, Frame::kProgressBar + fill);
+      frame.set(0, 12, 'a' + fill);
+      expected.set(0, 12, 'a' + fill);
+      const long bytes_before = display->controller[0]->bytes_written()
+        + display->controller[1]->bytes_written();
+      display->lcd->SubmitFrame(frame);
+      errors += CheckPanel(*display, expected);
+      const long bytes = display->controller[0]->bytes_written()
+        + display->controller[1]->bytes_written() - bytes_before;
+      // Per changed cell: set address and the character.
+      if (bytes > 4) {
+        fprintf(stderr, "%s: %ld bytes written for 2 cells\n",
+                display->name, bytes);
+        ++errors;
+      }
+    }
+  }
+  return errors;
+}
+
+// Write one nibble to "model" at "*nanos": RS and data are set "setup"
+// before E rises, E stays high 500ns and low "gap" afterwards.
+static void WriteNibble(HD44780Model *model, int64_t *nanos, bool rs,
+                        uint8_t nibble, int64_t setup, int64_t gap) {
+  const HD44780Model::Wiring w = LCDDisplay::wiring(0);
+  uint32_t levels = rs ? w.rs : 0;
+  uint32_t driven = w.enable | w.rs | w.rw;
+  for (int i = 0; i < 4; ++i) {
+    if (nibble & (1 << i)) levels |= w.data[i];
+    driven |= w.data[i];
+  }
+  model->Update(*nanos, levels, driven);
+  *nanos += setup;
+  model->Update(*nanos, levels | w.enable, driven);
+  *nanos += 500;
+  model->Update(*nanos, levels, driven);
+  *nanos += gap;
+}
+
+// Initializes 4 bit mode and writes "Hi", with the given nibble timing
+// and enough time for each instruction. Returns timing violations.
+static int WriteWithTiming(const char *name, int64_t setup, int64_t gap) {
+  HD44780Model model(name, LCDDisplay::wiring(0), NULL);
+  int64_t nanos = 0;
+  static const uint8_t kInit[] = { 0x3, 0x3, 0x3, 0x2 };
+  for (size_t i = 0; i < sizeof(kInit); ++i) {
+    WriteNibble(&model, &nanos, false, kInit[i], setup, gap);
+    nanos += 5000000;
+  }
+  static const uint8_t kBytes[] = { 0x28, 0x0c, 0x06, 0x80, 'H', 'i' };
+  for (size_t i = 0; i < sizeof(kBytes); ++i) {
+    const bool data = i >= 4;
+    WriteNibble(&model, &nanos, data, kBytes[i] >> 4, setup, gap);
+    WriteNibble(&model, &nanos, data, kBytes[i] & 0xf, setup, gap);
+    nanos += 40000;
+  }
+  if (memcmp(model.ddram(), "Hi", 2) != 0 || !model.display_on()) {
+    fprintf(stderr, "%s: not decoded as 'Hi'\n", name);
+    return -1;
+  }
+  printf("%s: %d timing violations (%d cycle time, %d address setup, "
+         "%d data hold)\n", name, model.total_violations(),
+         model.violations(HD44780Model::CYCLE_TIME),
+         model.violations(HD44780Model::ADDRESS_SETUP),
+         model.violations(HD44780Model::DATA_HOLD));
+  return model.total_violations();
+}
+
+// Returns number of problems in the VCD file: changes must come with
+// increasing timestamps.
+static int CheckWaveform(const char *filename) {
+  FILE *f = fopen(filename, "r");
+  if (f == NULL) {
+    perror(filename);
+    return 1;
+  }
+  char line[256];
+  long long last = -1;
+  long timestamps = 0;
+  long changes = 0;
+  int errors = 0;
+  bool definitions = true;
+  while (fgets(line, sizeof(line), f)) {
+    if (definitions) {
+      definitions = strncmp(line, "$enddefinitions", 15) != 0;
+    } else if (line[0] == '#') {
+      const long long now = atoll(line + 1);
+      if (now <= last && timestamps > 0) ++errors;
+      last = now;
+      ++timestamps;
+    } else if (line[0] == '0' || line[0] == '1') {
+      ++changes;
+    }
+  }
+  fclose(f);
+  printf("waveform: %ld pin changes at %ld times, %d out of order\n",
+         changes, timestamps, errors);
+  return (changes > 0) ? errors : errors + 1;
+}
+
+int main() {
+  // The timing WriteNibble() in lcd-display.cc has, and the one it had
+  // before: E raised together with RS and data, and no pause after it.
+  const int good_violations = WriteWithTiming("driver timing", 60, 550);
+  const int old_violations = WriteWithTiming("old timing", 0, 0);
+  if (good_violations != 0 || old_violations <= 0) {
+    printf("FAIL: model misjudges nibble timing\n");
+    return 1;
+  }
+
+  char waveform_file[] = "/tmp/lcd-sim-test-XXXXXX";
+  const int waveform_fd = mkstemp(waveform_file);
+  if (waveform_fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+
+  TestDisplay displays[] = {
+    { "16x2", 16, 2, NULL, { NULL, NULL } },
+    { "40x4", 40, 4, NULL, { NULL, NULL } },
+  };
+  const int count = sizeof(displays) / sizeof(displays[0]);
+  for (int d = 0; d < count; ++d) {
+    CreateDisplay(&displays[d], d == 0 ? fdopen(waveform_fd, "w") : NULL);
+    if (!displays[d].lcd->Init(d == 0)) {
+      fprintf(stderr, "%s: Init failed\n", displays[d].name);
+      return 1;
+    }
+  }
+
+  int errors = RunFrames(displays, count);
+  int violations = 0;
+  for (int d = 0; d < count; ++d) {
+    displays[d].lcd->SaveScreen();
+    for (int i = 0; i < 2; ++i) {
+      const HD44780Model *controller = displays[d].controller[i];
+      violations += controller->total_violations();
+      if (controller->display_on()) {
+        fprintf(stderr, "%s: display still on after SaveScreen()\n",
+                displays[d].name);
+        ++errors;
+      }
+    }
+  }
+  for (int d = 0; d < count; ++d) {
+    delete displays[d].lcd;  // Also deletes GPIO and controllers.
+  }
+  errors += CheckWaveform(waveform_file);
+  unlink(waveform_file);
+
+  if (errors > 0 || violations > 0) {
+    printf("FAIL: %d errors, %d timing violations\n",
+           errors, violations);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,142 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Plays hours of music on a simulated renderer in virtual time and checks,
+// every tick, what the display shows: title, elapsed and remaining time and
+// progress bar. Also a benchmark of the display update: reports the CPU
+// time per tick.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#include "clock.h"
+#include "frame.h"
+#include "line-buffer.h"
+#include "recording-printer.h"
+#include "renderer-events.h"
+#include "renderer-state.h"
+#include "upnp-display.h"
+
+static const int kTracks = 60;
+static const int kWidth = 20;
+static const int kTickMillis = 400;   // As in UPnPDisplay::Loop().
+static const int kStallSeconds = 5;   // At the end of a track.
+static const int kMaxReported = 10;
+
+static int failures = 0;
+
+static void Expect(const char *what, long tick, const char *expected,
+                   const LineBuffer &shown) {
+  if (strcmp(expected, shown.data()) == 0)
+    return;
+  if (++failures <= kMaxReported) {
+    fprintf(stderr, "tick %ld: %s is '%s', expected '%s'\n",
+            tick, what, shown.data(), expected);
+  }
+}
+
+// Time as UPnPDisplay shows it.
+static void FormatTime(int seconds, char *out, size_t size) {
+  const char *sign = (seconds < 0) ? "-" : "";
+  if (seconds < 0) seconds = -seconds;
+  snprintf(out, size, "%s%d:%02d", sign, seconds / 60, seconds % 60);
+}
+
+static double CpuSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main() {
+  VirtualClock clock(1000000);
+  RendererState state("uuid:playback-test", &clock, stderr);
+  RecordingPrinter printer(kWidth, 3);
+  UPnPDisplay display("", &printer, &clock, 0, stderr);
+  std::string error;
+  if (!display.SetLayout(0, "{title}", &error)
+      || !display.SetLayout(1, "{time} {remaining}", &error)
+      || !display.SetLayout(2, "{progress}", &error)) {
+    fprintf(stderr, "Layout: %s\n", error.c_str());
+    return 1;
+  }
+  display.AddRenderer("uuid:playback-test", &state);
+
+  long ticks = 0;
+  int64_t played_millis = 0;
+  double tick_seconds = 0;
+  LineBuffer shown;
+  char expected[64];
+  for (int track = 0; track < kTracks; ++track) {
+    const int duration = 90 + (track * 97) % 420;   // 1.5 to 8.5 minutes.
+    char title[32];
+    snprintf(title, sizeof(title), "Track %d", track + 1);
+    SendTrackEvent(&state, track + 1, title, "Artist", duration);
+    SendPositionInfo(&state, 0, duration);
+
+    const int64_t start = clock.NowMillis();
+    while (clock.NowMillis() - start < (duration + kStallSeconds) * 1000LL) {
+      clock.SleepMillis(kTickMillis);
+      const double tick_start = CpuSeconds();
+      display.Tick();
+      tick_seconds += CpuSeconds() - tick_start;
+      ++ticks;
+
+      int elapsed = (clock.NowMillis() - start) / 1000;
+      if (elapsed > duration) elapsed = duration;
+
+      printer.GetText(0, &shown);
+      Expect("title", ticks, title, shown);
+
+      char remaining[16];
+      FormatTime(elapsed - duration, remaining, sizeof(remaining));
+      FormatTime(elapsed, expected, sizeof(expected));
+      strcat(expected, " ");
+      strcat(expected, remaining);
+      printer.GetText(1, &shown);
+      Expect("time", ticks, expected, shown);
+
+      int pixels = 0;
+      for (int col = 0; col < kWidth; ++col) {
+        pixels += printer.frame().at(2, col) - Frame::kProgressBar;
+      }
+      const int permille = elapsed * 1000 / duration;
+      const int expected_pixels
+        = permille * kWidth * Frame::kProgressBarSteps / 1000;
+      if (pixels != expected_pixels && ++failures <= kMaxReported) {
+        fprintf(stderr, "tick %ld: progress bar has %d pixels, expected %d\n",
+                ticks, pixels, expected_pixels);
+      }
+    }
+    played_millis += clock.NowMillis() - start;
+  }
+
+  printf("%.1f hours of playback in %ld ticks: %.2f usec CPU per tick "
+         "(%.0f ticks/s); %ld display updates, %ld cells changed\n",
+         played_millis / 3600000.0, ticks, tick_seconds / ticks * 1e6,
+         ticks / tick_seconds, printer.updates(), printer.cells());
+  if (failures > 0) {
+    printf("FAIL: %d wrong display contents\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,75 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_TEST_RECORDING_PRINTER_
+#define UPNP_DISPLAY_TEST_RECORDING_PRINTER_
+
+#include "frame.h"
+#include "line-buffer.h"
+#include "printer.h"
+
+// Printer for tests: keeps the last frame and counts what it was asked to
+// update. Shows any character, so there is no transliteration.
+class RecordingPrinter : public Printer {
+public:
+  RecordingPrinter(int width, int height)
+    : width_(width), height_(height), frame_(width, height),
+      updates_(0), spans_(0), cells_(0), saves_(0) {}
+
+  virtual int width() const { return width_; }
+  virtual int height() const { return height_; }
+  virtual void SaveScreen() { ++saves_; }
+
+  // Current content of "row" as UTF-8 without leading or trailing spaces.
+  void GetText(int row, LineBuffer *text) const {
+    int begin = 0;
+    while (begin < width_ && frame_.at(row, begin) == ' ') ++begin;
+    Frame shifted(width_, height_);
+    for (int col = begin; col < width_; ++col) {
+      shifted.set(row, col - begin, frame_.at(row, col));
+    }
+    shifted.GetLine(row, text);
+  }
+
+  const Frame &frame() const { return frame_; }
+  long updates() const { return updates_; }  // Calls with changes.
+  long spans() const { return spans_; }
+  long cells() const { return cells_; }      // Changed cells.
+  long saves() const { return saves_; }
+
+protected:
+  virtual void ApplySpans(const Frame &frame,
+                          const Frame::Span *spans, int count) {
+    frame_ = frame;
+    ++updates_;
+    spans_ += count;
+    for (int i = 0; i < count; ++i) {
+      cells_ += spans[i].end - spans[i].begin;
+    }
+  }
+
+private:
+  const int width_;
+  const int height_;
+  Frame frame_;
+  long updates_;
+  long spans_;
+  long cells_;
+  long saves_;
+};
+
+#endif  // UPNP_DISPLAY_TEST_RECORDING_PRINTER_
@@ -0,0 +1,109 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_TEST_RENDERER_EVENTS_
+#define UPNP_DISPLAY_TEST_RENDERER_EVENTS_
+
+#include <stdio.h>
+
+#include <string>
+
+#include "renderer-state.h"
+
+// Play the renderer side for a RendererState in tests: send it events and
+// poll results as a renderer on the network would.
+
+// Give the renderer the description of a typical device, as if it was
+// discovered at "http://renderer/", so that it has control URLs to send
+// actions to. Without network, these actions fail right away.
+inline void SendDescription(RendererState *state,
+                            RendererState::SubscriptionMap *subscriptions) {
+  static const char kDescription[] =
+    "<root xmlns=\"urn:schemas-upnp-org:device-1-0\"><device>"
+    "<deviceType>urn:schemas-upnp-org:device:MediaRenderer:1</deviceType>"
+    "<friendlyName>Test Renderer</friendlyName><serviceList>"
+    "<service><serviceType>urn:schemas-upnp-org:service:AVTransport:1"
+    "</serviceType><controlURL>/avt/control</controlURL>"
+    "<eventSubURL>/avt/event</eventSubURL></service>"
+    "<service><serviceType>urn:schemas-upnp-org:service:RenderingControl:1"
+    "</serviceType><controlURL>/rc/control</controlURL>"
+    "<eventSubURL>/rc/event</eventSubURL></service>"
+    "</serviceList></device></root>";
+  state->InitDescription("http://renderer/description.xml",
+                         ixmlParseBuffer(kDescription));
+  state->SubscribeTo(-1, subscriptions);
+}
+
+// Format seconds as UPnP time "H:MM:SS".
+inline std::string UpnpTime(int seconds) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%d:%02d:%02d",
+           seconds / 3600, seconds / 60 % 60, seconds % 60);
+  return buffer;
+}
+
+// Event with the given variable elements, e.g. "<Volume val=\"42\"/>".
+inline void SendEvent(RendererState *state, const char *variables) {
+  std::string event("<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/AVT/\">"
+                    "<InstanceID val=\"0\">");
+  event.append(variables);
+  event.append("</InstanceID></Event>");
+  state->ReceiveLastChange(event.c_str());
+}
+
+// Event of a new track starting to play. The title and artist must not
+// contain XML special characters.
+inline void SendTrackEvent(RendererState *state, int track,
+                           const char *title, const char *artist,
+                           int duration_seconds) {
+  // DIDL-Lite metadata, escaped once more as it is an attribute value.
+  char didl[1024];
+  snprintf(didl, sizeof(didl),
+           "&lt;DIDL-Lite xmlns=&quot;urn:schemas-upnp-org:metadata-1-0/"
+           "DIDL-Lite/&quot; xmlns:dc=&quot;http://purl.org/dc/elements/1.1/"
+           "&quot; xmlns:upnp=&quot;urn:schemas-upnp-org:metadata-1-0/upnp/"
+           "&quot;&gt;&lt;item id=&quot;%d&quot; parentID=&quot;0&quot; "
+           "restricted=&quot;1&quot;&gt;&lt;dc:title&gt;%s&lt;/dc:title&gt;"
+           "&lt;upnp:artist&gt;%s&lt;/upnp:artist&gt;&lt;/item&gt;"
+           "&lt;/DIDL-Lite&gt;", track, title, artist);
+  char variables[2048];
+  snprintf(variables, sizeof(variables),
+           "<TransportState val=\"PLAYING\"/>"
+           "<CurrentTrackURI val=\"http://music/%d.flac\"/>"
+           "<CurrentTrackDuration val=\"%s\"/>"
+           "<CurrentTrackMetaData val=\"%s\"/>",
+           track, UpnpTime(duration_seconds).c_str(), didl);
+  SendEvent(state, variables);
+}
+
+// Response to a GetPositionInfo poll.
+inline void SendPositionInfo(RendererState *state, int position_seconds,
+                             int duration_seconds) {
+  char response[512];
+  snprintf(response, sizeof(response),
+           "<u:GetPositionInfoResponse "
+           "xmlns:u=\"urn:schemas-upnp-org:service:AVTransport:1\">"
+           "<Track>1</Track><TrackDuration>%s</TrackDuration>"
+           "<RelTime>%s</RelTime></u:GetPositionInfoResponse>",
+           UpnpTime(duration_seconds).c_str(),
+           UpnpTime(position_seconds).c_str());
+  IXML_Document *doc = ixmlParseBuffer(response);
+  state->ReceivePositionInfo(doc);
+  ixmlDocument_free(doc);
+}
+
+#endif  // UPNP_DISPLAY_TEST_RENDERER_EVENTS_
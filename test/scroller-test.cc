@@ -0,0 +1,79 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Checks that the Scroller reports a changed frame exactly when the
+// visible text changes, which is what lets the display skip rows, and
+// announces a move (for smooth scrolling) only if the next frame moves.
+
+#include <stdio.h>
+
+#include <string>
+
+#include "line-buffer.h"
+#include "scroller.h"
+
+static const int kTicks = 200;
+
+static int failures = 0;
+
+// Run "kTicks" ticks of "text" in "width"; count the ticks where
+// FrameChanged() does not match whether the visible text changed, or
+// where UpcomingMove() announced a move that did not happen.
+static void CheckChanges(const char *what, Scroller *scroller,
+                         const std::string &text, int width,
+                         int expected_changes) {
+  LineBuffer previous, shown;
+  int changes = 0, wrong = 0;
+  bool move_announced = false;
+  for (int tick = 0; tick < kTicks; ++tick) {
+    scroller->SetValue(text, width);
+    shown.Clear();
+    scroller->AppendScrolledContent(&shown);
+    const bool changed = (tick == 0 || shown != previous);
+    if (scroller->FrameChanged()) ++changes;
+    if (scroller->FrameChanged() != changed) ++wrong;
+    if (move_announced && !changed) ++wrong;
+    previous = shown;
+    scroller->NextTick();
+    uint32_t entering;
+    move_announced = scroller->UpcomingMove(&entering);
+  }
+  if (wrong > 0 || (expected_changes >= 0 && changes != expected_changes)) {
+    fprintf(stderr, "%s: %d changed frames, %d reported wrong\n",
+            what, changes, wrong);
+    ++failures;
+  }
+}
+
+int main() {
+  Scroller scroller(" - ");
+  CheckChanges("static", &scroller, "Short", 16, 1);
+  CheckChanges("new static value", &scroller, "Other", 16, 1);
+  CheckChanges("exact fit", &scroller, "Sixteen chars!!!", 16, 1);
+  CheckChanges("no space", &scroller, "Text", 0, 1);
+  CheckChanges("scrolling", &scroller, "A text longer than the display",
+               16, -1);
+  CheckChanges("static again", &scroller, "Short", 16, 1);
+
+  if (failures > 0) {
+    printf("FAIL: %d cases\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,104 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Smooth scrolling with heads of every width up to wider than the display:
+// the pixel shift must stay on the scrolling body, and there is none if
+// no body is visible.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "clock.h"
+#include "frame.h"
+#include "recording-printer.h"
+#include "renderer-events.h"
+#include "renderer-state.h"
+#include "upnp-display.h"
+
+static const int kWidth = 16;
+static const int kTickMillis = 400;       // As in UPnPDisplay::Loop().
+static const int kSmoothScrollSteps = 5;
+
+class ShiftingPrinter : public RecordingPrinter {
+public:
+  ShiftingPrinter() : RecordingPrinter(kWidth, 2) {}
+  virtual bool supports_pixel_shift() const { return true; }
+};
+
+// Plays a track whose title is "title_len" characters long, shown as head
+// of the first row, followed by a scrolling artist. Returns number of
+// failed checks.
+static int PlayTitle(int title_len) {
+  VirtualClock clock;
+  RendererState state("uuid:smooth", &clock, stderr);
+  ShiftingPrinter printer;
+  UPnPDisplay display("", &printer, &clock, 0, stderr);
+  display.set_smooth_scroll(true);
+  std::string error;
+  if (!display.SetLayout(0, "{title} {artist<}", &error)) {
+    fprintf(stderr, "Layout: %s\n", error.c_str());
+    return 1;
+  }
+  display.AddRenderer("uuid:smooth", &state);
+  const std::string title(title_len, 'T');
+  SendTrackEvent(&state, 1, title.c_str(),
+                 "An Artist With A Name Too Long For The Line", 300);
+  SendPositionInfo(&state, 0, 300);
+
+  // Where the body starts: after the title and a space, if there is room.
+  const int body_begin = title_len + 1;
+  int failures = 0;
+  int shifted_subticks = 0;
+  for (int tick = 0; tick < 100; ++tick) {
+    for (int step = 0; step < kSmoothScrollSteps; ++step) {
+      clock.SleepMillis(kTickMillis / kSmoothScrollSteps);
+      if (step == 0) display.Tick(); else display.SubTick(step);
+      const Frame::PixelShift &shift = printer.frame().pixel_shift(0);
+      if (shift.pixels == 0)
+        continue;
+      ++shifted_subticks;
+      if (shift.begin != body_begin || shift.end != kWidth) {
+        if (++failures <= 5) {
+          fprintf(stderr, "title of %d: shift of columns [%d, %d), "
+                  "expected [%d, %d)\n", title_len, shift.begin, shift.end,
+                  body_begin, kWidth);
+        }
+      }
+    }
+  }
+  if (body_begin < kWidth && shifted_subticks == 0) {
+    fprintf(stderr, "title of %d: body never shifted\n", title_len);
+    ++failures;
+  }
+  return failures;
+}
+
+int main() {
+  int failures = 0;
+  for (int title_len = 1; title_len <= kWidth + 4; ++title_len) {
+    failures += PlayTitle(title_len);
+  }
+  if (failures > 0) {
+    printf("FAIL: %d checks\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,161 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Checks that frames submitted to a ThreadedPrinter reach its delegate,
+// also in a process forked after construction, as with daemon(), and that
+// the spans passed on cover all changes, even of frames skipped.
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "frame.h"
+#include "line-buffer.h"
+#include "threaded-printer.h"
+
+// What the delegate showed last, in this process. Written by the writer
+// thread; read after the ThreadedPrinter is deleted, which joins it.
+static char shown[64];
+
+class LastLinePrinter : public Printer {
+public:
+  virtual void SaveScreen() {}
+
+protected:
+  virtual void ApplySpans(const Frame &frame, const Frame::Span *, int) {
+    LineBuffer line;
+    frame.GetLine(0, &line);
+    snprintf(shown, sizeof(shown), "%s", line.data());
+  }
+};
+
+// Slow delegate, so that frames are skipped. Checks that the spans it
+// gets cover all cells that differ from the frame before.
+class SpanCheckingPrinter : public Printer {
+public:
+  SpanCheckingPrinter(long *applied, long *uncovered)
+    : applied_(applied), uncovered_(uncovered) {}
+  virtual int width() const { return Frame::kMaxWidth; }
+  virtual int height() const { return Frame::kMaxHeight; }
+  virtual void SaveScreen() {}
+
+protected:
+  virtual void ApplySpans(const Frame &frame,
+                          const Frame::Span *spans, int count) {
+    usleep(100);
+    bool covered[Frame::kMaxHeight][Frame::kMaxWidth];
+    memset(covered, 0, sizeof(covered));
+    for (int i = 0; i < count; ++i) {
+      for (int col = spans[i].begin; col < spans[i].end; ++col)
+        covered[spans[i].row][col] = true;
+    }
+    for (int row = 0; row < frame.height(); ++row) {
+      for (int col = 0; col < frame.width(); ++col) {
+        if (*applied_ == 0 || frame.at(row, col) != previous_.at(row, col)) {
+          if (!covered[row][col]) ++*uncovered_;
+        }
+      }
+    }
+    previous_ = frame;
+    ++*applied_;
+  }
+
+private:
+  long *const applied_;
+  long *const uncovered_;
+  Frame previous_;
+};
+
+// Submit "text" in the first line, delete the printer and check that the
+// delegate showed it. Returns 'true' on success.
+static bool ShowAndDelete(ThreadedPrinter *printer, const char *text,
+                          const char *where) {
+  printer->Print(0, text);
+  delete printer;
+  if (strcmp(shown, text) != 0) {
+    fprintf(stderr, "%s: delegate shows '%s', expected '%s'\n",
+            where, shown, text);
+    return false;
+  }
+  return true;
+}
+
+// Fork, and in the child, run ShowAndDelete(). Returns 'true' if the child
+// succeeded.
+static bool ShowInChild(ThreadedPrinter *printer, const char *text,
+                        const char *where) {
+  const pid_t child = fork();
+  if (child == 0) {
+    alarm(5);  // Don't hang forever joining a thread that isn't there.
+    _exit(ShowAndDelete(printer, text, where) ? 0 : 1);
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "%s: child failed (status 0x%x)\n", where, status);
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  int failures = 0;
+
+  // Forked before the first frame, like main() becoming a daemon.
+  ThreadedPrinter *printer = new ThreadedPrinter(new LastLinePrinter());
+  if (!ShowInChild(printer, "Child", "fork before first frame"))
+    ++failures;
+  if (!ShowAndDelete(printer, "Parent", "parent after fork"))
+    ++failures;
+
+  // Forked while the writer thread already runs in the parent.
+  printer = new ThreadedPrinter(new LastLinePrinter());
+  printer->Print(0, "Before fork");
+  if (!ShowInChild(printer, "After fork", "fork while writing"))
+    ++failures;
+  if (!ShowAndDelete(printer, "Parent again", "parent while writing"))
+    ++failures;
+
+  // Many small changes, faster than the delegate can show them.
+  static const int kFrames = 5000;
+  long applied = 0, uncovered = 0;
+  printer = new ThreadedPrinter(new SpanCheckingPrinter(&applied,
+                                                        &uncovered));
+  Frame frame;
+  unsigned int random = 1;
+  for (int i = 0; i < kFrames; ++i) {
+    random = random * 1103515245 + 12345;
+    frame.set((random >> 8) % Frame::kMaxHeight,
+              (random >> 16) % Frame::kMaxWidth, 'a' + i % 26);
+    printer->SubmitFrame(frame);
+  }
+  delete printer;
+  printf("%d frames submitted, %ld shown\n", kFrames, applied);
+  if (uncovered > 0) {
+    fprintf(stderr, "%ld changed cells not in spans\n", uncovered);
+    ++failures;
+  }
+
+  if (failures > 0) {
+    printf("FAIL: %d checks\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,170 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "threaded-printer.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// Atomically replace "*value", return previous value. Full barrier, so that
+// everything written to a slot before is visible to the other thread.
+static int Exchange(volatile int *value, int new_value) {
+  int old;
+  do {
+    old = *value;
+  } while (!__sync_bool_compare_and_swap(value, old, new_value));
+  return old;
+}
+
+ThreadedPrinter::ThreadedPrinter(Printer *delegate)
+  : delegate_(delegate), width_(delegate->width()),
+    height_(delegate->height()),
+    pixel_shift_(delegate->supports_pixel_shift()),
+    back_(0), front_(1), middle_(2), quit_(false), writer_pid_(0) {
+  for (int row = 0; row < Frame::kMaxHeight; ++row) {
+    changed_begin_[row] = pending_begin_[row] = width_;
+    changed_end_[row] = pending_end_[row] = 0;
+  }
+  sem_init(&wakeup_, 0, 0);
+}
+
+ThreadedPrinter::~ThreadedPrinter() {
+  if (writer_pid_ == getpid()) {
+    quit_ = true;
+    __sync_synchronize();
+    sem_post(&wakeup_);
+    pthread_join(thread_, NULL);
+  }
+  sem_destroy(&wakeup_);
+  delete delegate_;
+}
+
+void ThreadedPrinter::StartWriter() {
+  const pid_t pid = getpid();
+  if (writer_pid_ == pid)
+    return;
+  writer_pid_ = pid;
+
+  // The display timing is sensitive, so make sure the kernel knows we are
+  // serious about it. Pinned to the last core, which on multi-core systems
+  // is less likely to be busy with interrupts.
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+  struct sched_param p;
+  p.sched_priority = 99;
+  pthread_attr_setschedparam(&attr, &p);
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  CPU_SET(cores > 1 ? cores - 1 : 0, &cpus);
+  pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  if (pthread_create(&thread_, &attr, &RunThread, this) != 0) {
+    fprintf(stderr,
+            "Couldn't set realtime priority which we need to make sure "
+            "hardware timing is correct .\nConsider running as root or "
+            "granting CAP_SYS_NICE capability "
+            "(sudo setcap cap_sys_nice=eip <program>).\n");
+    pthread_create(&thread_, NULL, &RunThread, this);
+  }
+  pthread_attr_destroy(&attr);
+}
+
+void ThreadedPrinter::Publish() {
+  // Changes of frames the writer skips need to be shown with this one.
+  Slot &slot = slots_[back_];
+  for (int row = 0; row < height_; ++row) {
+    slot.dirty_begin[row] = std::min(pending_begin_[row], changed_begin_[row]);
+    slot.dirty_end[row] = std::max(pending_end_[row], changed_end_[row]);
+  }
+
+  StartWriter();
+  const int previous = Exchange(&middle_, back_ | kFresh);
+  for (int row = 0; row < height_; ++row) {
+    if (previous & kFresh) {
+      // The previous frame will never be shown; all its changes are
+      // pending in the one just published.
+      pending_begin_[row] = slot.dirty_begin[row];
+      pending_end_[row] = slot.dirty_end[row];
+    } else {
+      // The writer took the previous frame.
+      pending_begin_[row] = changed_begin_[row];
+      pending_end_[row] = changed_end_[row];
+    }
+    changed_begin_[row] = width_;
+    changed_end_[row] = 0;
+  }
+  back_ = previous & ~kFresh;
+  sem_post(&wakeup_);
+}
+
+void ThreadedPrinter::ApplySpans(const Frame &frame,
+                                 const Frame::Span *spans, int count) {
+  // Merged per row; the delegate compares the cells anyway.
+  for (int i = 0; i < count; ++i) {
+    const Frame::Span &span = spans[i];
+    changed_begin_[span.row] = std::min(changed_begin_[span.row], span.begin);
+    changed_end_[span.row] = std::max(changed_end_[span.row], span.end);
+  }
+  slots_[back_].frame = frame;
+  slots_[back_].save_screen = false;
+  Publish();
+}
+
+void ThreadedPrinter::SaveScreen() {
+  slots_[back_].save_screen = true;
+  Publish();
+  InvalidateFrame();  // Whatever comes next needs to be shown.
+}
+
+void *ThreadedPrinter::RunThread(void *self) {
+  static_cast<ThreadedPrinter*>(self)->Run();
+  return NULL;
+}
+
+void ThreadedPrinter::Run() {
+  for (;;) {
+    while (sem_wait(&wakeup_) != 0) {}  // Retry on EINTR.
+    // Check quit first: a frame published before quitting still is shown.
+    const bool quit = quit_;
+    __sync_synchronize();
+    if (middle_ & kFresh) {
+      front_ = Exchange(&middle_, front_) & ~kFresh;
+      const Slot &slot = slots_[front_];
+      if (slot.save_screen) {
+        delegate_->SaveScreen();
+      } else {
+        int count = 0;
+        for (int row = 0; row < height_; ++row) {
+          if (slot.dirty_begin[row] >= slot.dirty_end[row])
+            continue;
+          Frame::Span &span = writer_spans_[count++];
+          span.row = row;
+          span.begin = slot.dirty_begin[row];
+          span.end = slot.dirty_end[row];
+        }
+        delegate_->SubmitFrame(slot.frame, writer_spans_, count);
+      }
+    }
+    if (quit) break;
+  }
+}
@@ -0,0 +1,112 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_THREADED_PRINTER_
+#define UPNP_DISPLAY_THREADED_PRINTER_
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+
+#include "printer.h"
+
+// Decouples a slow printer from whoever produces frames: frames are handed
+// to a writer thread through a mailbox and never block the caller. If the
+// writer can't keep up, intermediate frames are skipped; the latest frame
+// always wins. The changed spans are passed on, merged per row, and
+// include the changes of skipped frames.
+//
+// The writer thread is the only one that needs tight timing (e.g. for the
+// LCD), so it runs with realtime priority, pinned to one core, while the
+// rest of the process can stay at normal priority.
+//
+// The writer thread starts with the first frame, so the process can still
+// fork after construction (e.g. to become a daemon); a forked child starts
+// its own writer as threads don't survive fork(). Frames must be submitted
+// from one thread at a time.
+class ThreadedPrinter : public Printer {
+public:
+  // Takes ownership of "delegate", which is only accessed from the writer
+  // thread from now on.
+  explicit ThreadedPrinter(Printer *delegate);
+  virtual ~ThreadedPrinter();  // Shows the last frame, then stops writer.
+
+  virtual int width() const { return width_; }
+  virtual int height() const { return height_; }
+  virtual bool supports_pixel_shift() const { return pixel_shift_; }
+  virtual bool CanShow(Frame::Codepoint cp) const {
+    return delegate_->CanShow(cp);  // Only looks at constant tables.
+  }
+
+  virtual void SaveScreen();
+
+protected:
+  virtual void ApplySpans(const Frame &frame,
+                          const Frame::Span *spans, int count);
+
+private:
+  struct Slot {
+    Frame frame;
+    bool save_screen;   // Instead of showing the frame.
+    // Per row, cells [dirty_begin, dirty_end) might differ from the frame
+    // the writer showed before.
+    int dirty_begin[Frame::kMaxHeight];
+    int dirty_end[Frame::kMaxHeight];
+  };
+
+  static void *RunThread(void *self);
+  void Run();
+
+  // Start the writer thread, unless it runs in this process already.
+  void StartWriter();
+
+  // Publish the slot filled by the producer, with the changes in
+  // changed_begin_/changed_end_ and those still pending.
+  void Publish();
+
+  Printer *const delegate_;
+  const int width_;
+  const int height_;
+  const bool pixel_shift_;
+
+  // Triple buffer: the producer fills slots_[back_], the writer shows
+  // slots_[front_]. The third slot is the one in middle_, handed over by
+  // exchanging indices. kFresh is set in middle_ if it has not been
+  // picked up by the writer yet.
+  static const int kFresh = 0x4;
+  Slot slots_[3];
+  int back_;
+  int front_;
+  volatile int middle_;
+
+  // Producer side, per row: cells changed in the frame being published,
+  // and cells changed in frames published before that the writer might
+  // not have shown yet.
+  int changed_begin_[Frame::kMaxHeight];
+  int changed_end_[Frame::kMaxHeight];
+  int pending_begin_[Frame::kMaxHeight];
+  int pending_end_[Frame::kMaxHeight];
+
+  Frame::Span writer_spans_[Frame::kMaxHeight];  // Writer side.
+
+  volatile bool quit_;
+  sem_t wakeup_;
+  pthread_t thread_;
+  pid_t writer_pid_;    // Process the writer thread runs in; 0 if none.
+};
+
+#endif  // UPNP_DISPLAY_THREADED_PRINTER_
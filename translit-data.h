@@ -0,0 +1,34 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TRANSLIT_DATA_H
+#define TRANSLIT_DATA_H
+
+// Transliteration table. Defined in translit-data.c, that is generated
+// from font/translit.txt
+
+// Page number + 1 for each 64 codepoint page of the BMP; 0 if empty.
+extern const unsigned char kTranslitPageIndex[1024];
+
+// Offset in kTranslitStrings for each codepoint in a page; 0 if none.
+extern const unsigned short kTranslitPages[][64];
+
+// NUL-terminated replacements, one after the other.
+extern const char kTranslitStrings[];
+
+#endif  // TRANSLIT_DATA_H
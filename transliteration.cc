@@ -0,0 +1,33 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "transliteration.h"
+
+#include <stddef.h>
+
+#include "translit-data.h"
+
+const char *FindTransliteration(uint32_t codepoint) {
+  if (codepoint >= 0x10000)
+    return NULL;
+  const int page = kTranslitPageIndex[codepoint >> 6];
+  if (page == 0)
+    return NULL;
+  const unsigned short offset = kTranslitPages[page - 1][codepoint & 0x3f];
+  return offset ? kTranslitStrings + offset : NULL;
+}
@@ -0,0 +1,29 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+//  This file is part of UPnP LCD Display
+//
+//  Copyright (C) 2013 Henner Zeller <h.zeller@acm.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef UPNP_DISPLAY_TRANSLITERATION_
+#define UPNP_DISPLAY_TRANSLITERATION_
+
+#include <stdint.h>
+
+// Returns an ASCII replacement for "codepoint" to be used if it can't be
+// displayed (e.g. "Zh" for Ж, "-" for an em-dash), or NULL if there is
+// none. The replacement can be empty for characters that can be dropped.
+// Constant time: two table lookups.
+const char *FindTransliteration(uint32_t codepoint);
+
+#endif  // UPNP_DISPLAY_TRANSLITERATION_
@@ -22,15 +22,18 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 #include <stdlib.h>
 #include <time.h>
 
 #include <pthread.h>
 
+#include <algorithm>
+
+#include "line-buffer.h"
 #include "printer.h"
 #include "renderer-state.h"
 #include "scroller.h"
+#include "transliteration.h"
 #include "utf8.h"
 
 // Time between display updates.
@@ -38,6 +41,11 @@
 // Note, too fast scrolling looks blurry on cheap displays.
 static const int kDisplayUpdateMillis = 400;
 
+// With smooth scrolling, each display update period is divided in this many
+// steps; in each, scrolling text moves by one of the 5 pixel columns of a
+// character.
+static const int kSmoothScrollSteps = 5;
+
 // Number of periods, a changed volume flashes up.
 static const int kVolumeFlashTime = 3;
 
@@ -52,189 +60,353 @@ static void SigReceiver(int) {
 #define PLAY_SYMBOL "\u25b6"   // ▶
 #define PAUSE_SYMBOL "]["      // TODO: add symbol in private unicode range.
 
+// Default layouts depending on display height, see layout.h for the syntax.
+static const char *const
+kDefaultLayouts[Printer::kMaxHeight][Printer::kMaxHeight] = {
+  { "{composer: }{title}" },
+  { "{composer: }{title}", "{time} {album/artist>}" },
+  { "{composer: }{title}", "{artist}", "{time} {album>}" },
+  { "{composer: }{title}", "{artist}", "{album}{ (year)}",
+    "{time} {player>}" },
+};
+
 UPnPDisplay::UPnPDisplay(const std::string &friendly_name, Printer *printer,
-                         int screensave_timeout, FILE *logstream)
+                         Clock *clock, int screensave_timeout,
+                         FILE *logstream)
   : player_match_name_(friendly_name),
-    printer_(printer), logstream_(logstream),
+    printer_(printer), clock_(clock), logstream_(logstream),
     screensave_timeout_(screensave_timeout),
-    current_state_(NULL) {
+    height_(printer->height()),
+    current_state_(NULL),
+    scrollers_(Printer::kMaxHeight, Scroller("  -  ")),
+    play_state_("STOPPED"),
+    frame_(printer->width(), printer->height()),
+    smooth_scroll_(false), layout_shown_(false),
+    blink_time_(0), volume_countdown_(0) {
+  assert(height_ >= 1 && height_ <= Printer::kMaxHeight);
   pthread_mutex_init(&mutex_, NULL);
   signal(SIGTERM, &SigReceiver);
   signal(SIGINT, &SigReceiver);
+  std::string error;
+  for (int i = 0; i < height_; ++i) {
+    layouts_[i].Compile(kDefaultLayouts[height_ - 1][i], &error);
+  }
 }
 
-void UPnPDisplay::Loop() {
-  std::string player_name;
-  std::string title, composer, artist, album;
-  std::string play_state = "STOPPED";
-  std::string volume, previous_volume;
-  time_t last_update = 0;
-  int track_time = 0;
-  int relative_time = 0;
+bool UPnPDisplay::SetLayout(int line, const std::string &layout_template,
+                            std::string *error) {
+  if (line < 0 || line >= height_) {
+    *error = "No such line.";
+    return false;
+  }
+  return layouts_[line].Compile(layout_template, error);
+}
 
-  Scroller first_line_scroller("  -  ");
-  Scroller second_line_scroller("  -  ");
-  unsigned char blink_time = 0;
-  int volume_countdown = 0;
+// Names of the renderer variables we poll. Constants, so that looking them
+// up every tick does not create temporary strings.
+static const std::string kVarTitle("Meta_Title");
+static const std::string kVarComposer("Meta_Composer");
+static const std::string kVarArtist("Meta_Artist");
+static const std::string kVarCreator("Meta_Creator");
+static const std::string kVarAlbum("Meta_Album");
+static const std::string kVarGenre("Meta_Genre");
+static const std::string kVarYear("Meta_Year");
+static const std::string kVarTransportState("TransportState");
+static const std::string kVarTrackDuration("CurrentTrackDuration");
+static const std::string kVarVolume("Volume");
+static const std::string kVarMute("Mute");
+
+void UPnPDisplay::Tick() {
+  const bool layout_in_frame = layout_shown_;
+  layout_shown_ = false;
+  frame_.ClearPixelShifts();
+  if (ComposeFrame(layout_in_frame)) {
+    printer_->SubmitFrame(frame_);
+  }
+}
 
-  signal_received = false;
-  while (!signal_received) {
-    usleep(kDisplayUpdateMillis * 1000);
-    const time_t now = time(NULL);
-    last_update = 0;
-    bool renderer_available = false;
-    bool muted = false;
-    pthread_mutex_lock(&mutex_);
-    if (current_state_ != NULL) {
-      renderer_available = true;
-      player_name = current_state_->friendly_name();
-      title = current_state_->GetVar("Meta_Title");
-      composer = current_state_->GetVar("Meta_Composer");
-      artist = current_state_->GetVar("Meta_Artist");
-      std::string creator = current_state_->GetVar("Meta_Creator");
-      if (artist == composer && !creator.empty() && creator != artist) {
-        artist = creator;
-      }
-      album = current_state_->GetVar("Meta_Album");
-      play_state = current_state_->GetVar("TransportState");
-      // "RelativeTimePosition" var is not evented by default.
-      // TODO: query actively.
-      relative_time = 0;
-      // for now, we just show the duration.
-      track_time = parseTime(current_state_->GetVar("CurrentTrackDuration"));
-      volume = current_state_->GetVar("Volume");
-      muted = current_state_->GetVar("Mute") == "1";
-      last_update = current_state_->last_event_update();
+void UPnPDisplay::SubTick(int step) {
+  if (!smooth_scroll_ || !layout_shown_)
+    return;
+  // The scrollers already point to the upcoming frame; move towards it.
+  for (int row = 0; row < height_; ++row) {
+    uint32_t entering;
+    // A head as wide as the display leaves nothing to shift.
+    if (scroll_begin_[row] < printer_->width()
+        && scrollers_[row].UpcomingMove(&entering)) {
+      frame_.SetPixelShift(row, scroll_begin_[row], printer_->width(),
+                           step * 5 / kSmoothScrollSteps, entering);
     }
-    pthread_mutex_unlock(&mutex_);
+  }
+  printer_->SubmitFrame(frame_);
+}
 
-    if (screensave_timeout_ > 0 && last_update > 0 &&
-        (now - last_update) > screensave_timeout_) {
-      printer_->SaveScreen();
-      continue;
-    }
+bool UPnPDisplay::ComposeFrame(bool layout_in_frame) {
+  // All strings are members and only re-assigned, so they keep their
+  // capacity. In steady state, a tick does not allocate memory.
+  // Text fields are first received as they are, see below.
+  std::string &composer = received_[FIELD_COMPOSER];
+  std::string &artist = received_[FIELD_ARTIST];
+  std::string &volume = fields_[FIELD_VOLUME];
+  int64_t last_update = 0;
+  int track_time = 0;
+  int relative_time = -1;
 
-    if (!renderer_available) {
-      printer_->Print(0, "Waiting for");
-      std::string to_print = (player_match_name_.empty()
-                              ? "any Renderer"
-                              : player_match_name_);
-      CenterAlign(&to_print, printer_->width());
-      printer_->Print(1, to_print);
-      continue;
-    }
+  // Volume and play state messages are shown in the last line.
+  const int status_row = height_ - 1;
 
-    // First line is "[composer: ]Title"
-    std::string print_line = composer;
-    if (!print_line.empty()) print_line.append(": ");
-    print_line.append(title);
-
-    const bool no_title_to_display = (print_line.empty() && album.empty());
-    if (no_title_to_display) {
-      // No title, so show at least player name.
-      print_line = player_name;
-      CenterAlign(&print_line, printer_->width());
-      printer_->Print(0, print_line);
+  const int64_t now = clock_->NowMillis();
+  bool renderer_available = false;
+  bool muted = false;
+  pthread_mutex_lock(&mutex_);
+  if (current_state_ != NULL) {
+    renderer_available = true;
+    received_[FIELD_PLAYER].assign(current_state_->friendly_name());
+    current_state_->GetVar(kVarTitle, &received_[FIELD_TITLE]);
+    current_state_->GetVar(kVarComposer, &composer);
+    current_state_->GetVar(kVarArtist, &artist);
+    current_state_->GetVar(kVarCreator, &creator_);
+    if (artist == composer && !creator_.empty() && creator_ != artist) {
+      artist.assign(creator_);
     }
+    current_state_->GetVar(kVarAlbum, &received_[FIELD_ALBUM]);
+    current_state_->GetVar(kVarGenre, &received_[FIELD_GENRE]);
+    current_state_->GetVar(kVarYear, &received_[FIELD_YEAR]);
+    current_state_->GetVar(kVarTransportState, &play_state_);
+    // "RelativeTimePosition" var is not evented; the controller polls it
+    // in the background and the renderer state interpolates it for us.
+    relative_time = current_state_->GetPlaybackPosition();
+    current_state_->GetVar(kVarTrackDuration, &track_duration_);
+    track_time = parseTime(track_duration_);
+    current_state_->GetVar(kVarVolume, &volume);
+    current_state_->GetVar(kVarMute, &mute_);
+    muted = (mute_ == "1");
+    last_update = current_state_->last_event_update();
+  }
+  pthread_mutex_unlock(&mutex_);
 
-    // Second line: Show volume related things if relevant.
-    // Either we're muted, or there was a volume change that we display
-    // for kVolumeFlashTime
-    if (muted) {
-      print_line = "[Muted]";
-      CenterAlign(&print_line, printer_->width());
-      printer_->Print(1, print_line);
-      continue;
-    }
-    else if (volume != previous_volume || volume_countdown > 0) {
-      if (!previous_volume.empty()) {
-        if (volume != previous_volume) {
-          volume_countdown = kVolumeFlashTime;
-        } else {
-          --volume_countdown;
-        }
-        std::string volume_line = "Volume " + volume;
-        CenterAlign(&volume_line, printer_->width());
-        printer_->Print(1, volume_line);
-      }
-      previous_volume = volume;
-      continue;
+  // Metadata can contain anything; the display might not. Like the
+  // scroller, only do the work when a value changes.
+  static const LayoutField kTextFields[] = {
+    FIELD_TITLE, FIELD_ARTIST, FIELD_ALBUM, FIELD_COMPOSER, FIELD_GENRE,
+    FIELD_YEAR, FIELD_PLAYER
+  };
+  for (size_t i = 0; i < sizeof(kTextFields) / sizeof(kTextFields[0]); ++i) {
+    const LayoutField field = kTextFields[i];
+    if (received_[field] != transliterated_from_[field]) {
+      transliterated_from_[field].assign(received_[field]);
+      Transliterate(received_[field], &fields_[field]);
     }
+  }
+  const std::string &title = fields_[FIELD_TITLE];
+  const std::string &album = fields_[FIELD_ALBUM];
+  const std::string &player_name = fields_[FIELD_PLAYER];
+
+  // The renderer time-stamps events with the same clock.
+  if (screensave_timeout_ > 0 && renderer_available &&
+      (now - last_update) > screensave_timeout_ * 1000LL) {
+    printer_->SaveScreen();
+    return false;
+  }
 
-    if (no_title_to_display) {
-      // Nothing really to display ? Show play-state.
-      print_line = play_state;
-      if (play_state == "STOPPED")
-        print_line = STOP_SYMBOL " [Stopped]";
-      else if (play_state == "PAUSED_PLAYBACK")
-        print_line = PAUSE_SYMBOL" [Paused]";
-      else if (play_state == "PLAYING")
-        print_line = PLAY_SYMBOL " [Playing]";
-
-      CenterAlign(&print_line, printer_->width());
-      printer_->Print(1, print_line);
-      continue;
+  if (!renderer_available) {
+    line_.Clear();
+    line_.Append("Waiting for");
+    if (height_ > 1) {
+      frame_.SetLine(0, line_);
+      line_.Clear();
+    } else {
+      line_.Append(" ");
+    }
+    if (player_match_name_.empty()) {
+      line_.Append("any Renderer");
+    } else {
+      line_.Append(player_match_name_);
     }
+    line_.CenterAlign(printer_->width());
+    frame_.SetLine(height_ > 1 ? 1 : 0, line_);
+    ClearRows(2, height_);
+    return true;
+  }
 
-    // Alright, we have a title. If short enough, center, otherwise scroll.
-    CenterAlign(&print_line, printer_->width());
-    first_line_scroller.SetValue(print_line, printer_->width());
-    printer_->Print(0, first_line_scroller.GetScrolledContent());
+  const bool no_title_to_display
+    = (fields_[FIELD_COMPOSER].empty() && title.empty() && album.empty());
+  if (no_title_to_display) {
+    // No title, so show at least player name.
+    line_.Clear();
+    line_.Append(player_name);
+    line_.CenterAlign(printer_->width());
+    frame_.SetLine(0, line_);
+    ClearRows(1, status_row);
+  }
 
-    std::string formatted_time;
-    if (play_state == "STOPPED") {
-      formatted_time = "  " STOP_SYMBOL " ";
-    } else {
-      // relative time might not be evented. In that case, show track time.
-      const int show_time = relative_time ? relative_time : track_time;
-      formatted_time = formatTime(show_time);
-      // 'Blinking' time when paused.
-      if (play_state == "PAUSED_PLAYBACK" && blink_time % 2 == 0) {
-        formatted_time = std::string(formatted_time.size(), ' ');
+  // Second line: Show volume related things if relevant.
+  // Either we're muted, or there was a volume change that we display
+  // for kVolumeFlashTime
+  if (muted) {
+    line_.Clear();
+    line_.Append("[Muted]");
+    line_.CenterAlign(printer_->width());
+    frame_.SetLine(status_row, line_);
+    return true;
+  }
+  else if (volume != previous_volume_ || volume_countdown_ > 0) {
+    if (!previous_volume_.empty()) {
+      if (volume != previous_volume_) {
+        volume_countdown_ = kVolumeFlashTime;
+      } else {
+        --volume_countdown_;
       }
+      line_.Clear();
+      line_.Append("Volume ");
+      line_.Append(volume);
+      line_.CenterAlign(printer_->width());
+      frame_.SetLine(status_row, line_);
     }
-    const int remaining_len = printer_->width() - formatted_time.length() - 1;
+    previous_volume_.assign(volume);
+    return true;
+  }
 
-    // Assemble second line from album. Add artist, but only if we wouldn't
-    // exceed length (or, if we already exceed length, also append).
-    print_line = album;
+  if (no_title_to_display) {
+    // Nothing really to display ? Show play-state.
+    line_.Clear();
+    if (play_state_ == "STOPPED")
+      line_.Append(STOP_SYMBOL " [Stopped]");
+    else if (play_state_ == "PAUSED_PLAYBACK")
+      line_.Append(PAUSE_SYMBOL" [Paused]");
+    else if (play_state_ == "PLAYING")
+      line_.Append(PLAY_SYMBOL " [Playing]");
+    else
+      line_.Append(play_state_);
+
+    line_.CenterAlign(printer_->width());
+    frame_.SetLine(status_row, line_);
+    return true;
+  }
 
-    std::string artist_addition;
-    if (!artist.empty() && artist != album) {
-      if (!print_line.empty()) artist_addition.append("/");
-      artist_addition.append(artist);
+  formatted_time_.Clear();
+  fields_[FIELD_REMAINING].clear();
+  fields_[FIELD_PROGRESS].clear();
+  if (play_state_ == "STOPPED") {
+    fields_[FIELD_STATE].assign(STOP_SYMBOL);
+    formatted_time_.Append("  " STOP_SYMBOL " ");
+  } else {
+    fields_[FIELD_STATE].assign(play_state_ == "PAUSED_PLAYBACK"
+                                ? PAUSE_SYMBOL : PLAY_SYMBOL);
+    // If the renderer does not tell the position, show track time.
+    const int show_time = relative_time >= 0 ? relative_time : track_time;
+    formatTime(show_time, &formatted_time_);
+    if (relative_time >= 0 && track_time > 0) {
+      formatted_remaining_.Clear();
+      formatTime(relative_time - track_time, &formatted_remaining_);
+      fields_[FIELD_REMAINING].assign(formatted_remaining_.data(),
+                                      formatted_remaining_.size());
+      char permille[8];
+      snprintf(permille, sizeof(permille), "%d",
+               relative_time >= track_time
+               ? 1000 : (int)(relative_time * 1000LL / track_time));
+      fields_[FIELD_PROGRESS].assign(permille);
     }
-    // Only append it if we'd stay within allocated screen-width. Unless the
-    // Album name is already so long that we'd exceed the length anyway. In
-    // that case, we have to scroll no matter what and including the artist
-    // does less harm.
-    if (utf8_len(print_line + artist_addition) <= remaining_len
-        || utf8_len(print_line) > remaining_len) {
-      print_line += artist_addition;
+    // 'Blinking' time when paused.
+    if (play_state_ == "PAUSED_PLAYBACK" && blink_time_ % 2 == 0) {
+      const int time_len = formatted_time_.characters();
+      formatted_time_.Clear();
+      formatted_time_.AppendRepeated(' ', time_len);
+    }
+  }
+  fields_[FIELD_TIME].assign(formatted_time_.data(), formatted_time_.size());
+
+  // Alright, we have a title. Lay out the lines; if the variable part is
+  // short enough it is aligned, otherwise scrolled. Most of the time, most
+  // rows are just as in the previous tick.
+  for (int row = 0; row < height_; ++row) {
+    if (RenderLayout(row, fields_, layout_in_frame, &line_)) {
+      frame_.SetLine(row, line_);
+    }
+  }
+  layout_shown_ = true;
+
+  blink_time_++;
+  for (int row = 0; row < height_; ++row) {
+    scrollers_[row].NextTick();
+  }
+  return true;
+}
+
+void UPnPDisplay::Loop(const std::vector<UPnPDisplay*> &displays,
+                       Clock *clock) {
+  int steps = 1;
+  for (size_t i = 0; i < displays.size(); ++i) {
+    if (displays[i]->smooth_scroll_) steps = kSmoothScrollSteps;
+  }
+
+  signal_received = false;
+  while (!signal_received) {
+    for (int step = 0; step < steps && !signal_received; ++step) {
+      clock->SleepMillis(kDisplayUpdateMillis / steps);
+      for (size_t i = 0; i < displays.size(); ++i) {
+        if (step == 0) {
+          displays[i]->Tick();
+        } else {
+          displays[i]->SubTick(step);
+        }
+      }
     }
+  }
 
-    // Show album/artist right aligned in space next to time. Or scroll if long.
-    RightAlign(&print_line, remaining_len);
-    second_line_scroller.SetValue(print_line, remaining_len);
-    printer_->Print(1, formatted_time + " "
-                    + second_line_scroller.GetScrolledContent());
+  for (size_t i = 0; i < displays.size(); ++i) {
+    displays[i]->ShowGoodbye();
+  }
+}
+
+void UPnPDisplay::ShowGoodbye() {
+  line_.Clear();
+  line_.Append("Goodbye!");
+  line_.CenterAlign(printer_->width());
+  frame_.SetLine(0, line_);
+  if (height_ > 1) {
+    // Show off unicode :)
+    line_.Clear();
+    line_.Append("\u2192 \u266a\u266b\u266a\u2669 \u2190");  // → ♪♫♩ ←
+    line_.CenterAlign(printer_->width());
+    frame_.SetLine(1, line_);
+  }
+  ClearRows(2, height_);
+  printer_->SubmitFrame(frame_);
+}
 
-    blink_time++;
-    first_line_scroller.NextTick();
-    second_line_scroller.NextTick();
+void UPnPDisplay::ClearRows(int first, int end) {
+  const LineBuffer empty;
+  for (int row = first; row < end; ++row) {
+    frame_.SetLine(row, empty);
   }
+}
 
-  std::string msg = "Goodbye!";
-  CenterAlign(&msg, printer_->width());
-  printer_->Print(0, msg);
-  // Show off unicode :)
-  msg = "\u2192 \u266a\u266b\u266a\u2669 \u2190";  // → ♪♫♩ ←
-  CenterAlign(&msg, printer_->width());
-  printer_->Print(1, msg);
+bool UPnPDisplay::RenderLayout(int row, const std::string *fields,
+                               bool may_skip, LineBuffer *line) {
+  const LineLayout &layout = layouts_[row];
+  Scroller *const scroller = &scrollers_[row];
+  layout.Render(fields, printer_->width(), &layout_head_, &layout_body_);
+  const int body_width = std::max(0, printer_->width()
+                                  - utf8_len(layout_head_));
+  switch (layout.body_alignment()) {
+  case LineLayout::ALIGN_LEFT:   break;
+  case LineLayout::ALIGN_CENTER: CenterAlign(&layout_body_, body_width); break;
+  case LineLayout::ALIGN_RIGHT:  RightAlign(&layout_body_, body_width); break;
+  }
+  scroller->SetValue(layout_body_, body_width);
+  if (may_skip && !scroller->FrameChanged() && layout_head_ == shown_head_[row])
+    return false;
+  shown_head_[row].assign(layout_head_);
+  line->Clear();
+  line->Append(layout_head_);
+  scroll_begin_[row] = std::min(line->characters(), printer_->width());
+  scroller->AppendScrolledContent(line);
+  return true;
 }
 
 void UPnPDisplay::AddRenderer(const std::string &uuid,
-                              const RendererState *state) {
+                              RendererState *state) {
   // Not to LCD, different thread
   fprintf(logstream_, "%s: connected (name='%s')\n",
           uuid.c_str(), state->friendly_name().c_str());
@@ -267,7 +439,24 @@ int UPnPDisplay::parseTime(const std::string &upnp_time) {
   return 0;
 }
 
-std::string UPnPDisplay::formatTime(int time) {
+void UPnPDisplay::Transliterate(const std::string &text, std::string *out) {
+  out->clear();
+  std::string::const_iterator it = text.begin();
+  while (it != text.end()) {
+    const std::string::const_iterator start = it;
+    const uint32_t cp = utf8_next_codepoint(it);
+    const char *replacement = NULL;
+    if (cp >= 0x80 && !printer_->CanShow(cp))
+      replacement = FindTransliteration(cp);
+    if (replacement != NULL) {
+      out->append(replacement);
+    } else {
+      out->append(start, it);
+    }
+  }
+}
+
+void UPnPDisplay::formatTime(int time, LineBuffer *out) {
   const bool is_neg = (time < 0);
   time = abs(time);
   const int hour = time / 3600; time %= 3600;
@@ -281,19 +470,19 @@ std::string UPnPDisplay::formatTime(int time) {
   } else {
     snprintf(pos, sizeof(buf)-1, "%d:%02d", minute, second);
   }
-  return buf;
+  out->Append(buf);
 }
 
 void UPnPDisplay::CenterAlign(std::string *to_print, int width) {
   const int len = utf8_len(*to_print);
   if (len < width) {
-    to_print->insert(0, std::string((width - len) / 2, ' '));
+    to_print->insert(0, (width - len) / 2, ' ');
   }
 }
 
 void UPnPDisplay::RightAlign(std::string *to_print, int width) {
   const int len = utf8_len(*to_print);
   if (len < width) {
-    to_print->insert(0, std::string(width - len, ' '));
+    to_print->insert(0, width - len, ' ');
   }
 }
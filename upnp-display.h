@@ -19,29 +19,59 @@
 #define UPNP_DISPLAY_H
 
 #include <string>
+#include <vector>
 
+#include "clock.h"
+#include "layout.h"
 #include "observer.h"
+#include "printer.h"
+#include "scroller.h"
 #include <pthread.h>
 #include <stdio.h>
+#include <time.h>
 
-class Printer;
 
 class UPnPDisplay : public ControllerObserver {
 public:
   // Creates upnp display that waits for a renderer with the given
   // registered name (if empty string, waits for the first available).
-  // Outputs to "printer".
+  // Outputs to "printer", timing is determined by "clock". Both are not
+  // owned.
   UPnPDisplay(const std::string &renderer_registered_name, Printer *printer,
-              int screensave_timeout, FILE *logstream);
+              Clock *clock, int screensave_timeout, FILE *logstream);
 
-  // Main Loop. Only exits on catching SIGTERM or SIGINT (Ctrl-c)
-  void Loop();
+  // Set the layout template for the given line (see layout.h for syntax).
+  // Returns 'false' and sets "error" if the template can't be parsed.
+  bool SetLayout(int line, const std::string &layout_template,
+                 std::string *error);
+
+  // Main Loop, updating all "displays" in lock-step with timing given by
+  // "clock". Only exits on catching SIGTERM or SIGINT (Ctrl-c)
+  static void Loop(const std::vector<UPnPDisplay*> &displays, Clock *clock);
+
+  // Fetch the current state and update the display once. Loop() calls this
+  // every display period; test drivers can call it directly.
+  void Tick();
+
+  // Scroll smoothly: in between ticks, move scrolling text in pixel steps
+  // towards its next position. Only if the printer supports pixel shifts
+  // (see Frame::SetPixelShift()).
+  void set_smooth_scroll(bool on) {
+    smooth_scroll_ = on && printer_->supports_pixel_shift();
+  }
+
+  // With smooth scrolling, Loop() calls this in between Tick()s with
+  // "step" 1..4, the fraction of the way towards the next character.
+  void SubTick(int step);
+
+  // Final message before exit.
+  void ShowGoodbye();
 
   // -- Implementation of ControllerObserver interface.
 
   // Receive notification of new renderer added.
   virtual void AddRenderer(const std::string &uuid,
-                           const RendererState *state);
+                           RendererState *state);
   // Receive notification of renderer removed.
   virtual void RemoveRenderer(const std::string &uuid);
 
@@ -49,21 +79,70 @@ private:
   // Parse time from UPnP variable.
   int parseTime(const std::string &upnp_time);
 
-  // Format time for display.
-  std::string formatTime(int time);
+  // Format time for display; appends to "out".
+  void formatTime(int time, LineBuffer *out);
 
-  // Text formatting utility.
+  // Text formatting utility for text that is longer than a display line.
   void CenterAlign(std::string *to_print, int width);
   void RightAlign(std::string *to_print, int width);
 
+  // Render the layout of given row into "line", scrolling its body.
+  // Returns 'false' if "line" is left alone because the row is the same as
+  // in the previous tick; only if "may_skip".
+  bool RenderLayout(int row, const std::string *fields, bool may_skip,
+                    LineBuffer *line);
+
+  // Compose the current state into frame_. Returns 'false' if the screen
+  // is to be saved instead. If "layout_in_frame", frame_ still has the
+  // layout of the previous tick, so unchanged rows don't need to be set.
+  bool ComposeFrame(bool layout_in_frame);
+
+  // Copy "text" to "out", replacing characters the printer can't show
+  // with their transliteration, if there is one.
+  void Transliterate(const std::string &text, std::string *out);
+
+  // Print empty lines in rows [first, end).
+  void ClearRows(int first, int end);
+
   const std::string player_match_name_;
   Printer *const printer_;
+  Clock *const clock_;
   FILE *const logstream_;
   const int screensave_timeout_;
+  const int height_;
   pthread_mutex_t mutex_;
 
   std::string uuid_;
-  const RendererState *current_state_;
+  RendererState *current_state_;
+
+  // Each row has its own layout and scroller.
+  LineLayout layouts_[Printer::kMaxHeight];
+  std::vector<Scroller> scrollers_;
+  std::string layout_head_;   // Scratch space for rendering layouts.
+  std::string layout_body_;
+  std::string shown_head_[Printer::kMaxHeight];  // Head of each row.
+
+  // State kept between ticks. Strings keep their capacity, so a tick
+  // in steady state does not allocate.
+  std::string fields_[NUM_LAYOUT_FIELDS];
+  // Text fields as received from the renderer, and the values the
+  // transliterated fields_ were made from.
+  std::string received_[NUM_LAYOUT_FIELDS];
+  std::string transliterated_from_[NUM_LAYOUT_FIELDS];
+  std::string creator_;
+  std::string play_state_;
+  std::string previous_volume_;
+  std::string mute_;
+  std::string track_duration_;
+  LineBuffer line_;              // Line to be placed in the frame.
+  LineBuffer formatted_time_;
+  LineBuffer formatted_remaining_;
+  Frame frame_;                  // Composed, then submitted to printer.
+  bool smooth_scroll_;
+  bool layout_shown_;            // Last Tick() showed the scrolled layout.
+  int scroll_begin_[Printer::kMaxHeight];  // Column the scrolled body starts.
+  unsigned char blink_time_;
+  int volume_countdown_;
 };
 
 #endif  // UPNP_DISPLAY_H